@@ -0,0 +1,3 @@
+#!/usr/bin/env bash
+
+gcc -O2 kilo.c -o kilo-bench -DEDITOR_BENCH -Wall -Wextra -Werror -pedantic -std=c99 -pthread && ./kilo-bench $@
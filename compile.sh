@@ -1,3 +1,3 @@
 #!/usr/bin/env bash
 
-gcc -g kilo.c -o kilo -Wall -Wextra -pedantic -std=c99
+gcc -g kilo.c -o kilo -Wall -Wextra -pedantic -std=c99 -pthread
@@ -1,3 +1,3 @@
 #!/usr/bin/env bash
 
-gcc -g kilo.c -o kilo -Wall -Wextra -Werror -pedantic -std=c99 && gdb ./kilo
+gcc -g kilo.c -o kilo -Wall -Wextra -Werror -pedantic -std=c99 -pthread && gdb ./kilo
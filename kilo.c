@@ -1,4 +1,5 @@
 #define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700 // realpath
 /*** includes ***/
 
 #include <stdlib.h>
@@ -10,9 +11,25 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <limits.h>
 #include <termios.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
 
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEARCH_SIMD 1
+#endif
 
 /*** defines ***/
 
@@ -21,20 +38,68 @@
 #define EDITOR_TAB "    "
 #define EDITOR_TAB_LEN (sizeof(EDITOR_TAB) - 1)
 #define EDITOR_MSG_LEN 128
+#define EDITOR_MSG_MS 5000
 #define EDITOR_QUIT_CONFIRM 3
+#define EDITOR_INDEX_FIRST (64 << 10) // bytes of a mapped file split into lines for the first screen
+#define EDITOR_INDEX_CHUNK (64 << 20) // bytes of a mapped file split into lines per step after that
+#define LINE_BLOCK_MAX 512
+#define COLD_HOT_BLOCKS 256 // blocks kept as lines, the least recently touched past this are compressed
+#define COLD_MAX_TEXT (1 << 30) // bytes of a block's text past which it is left hot
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_BOUND(len) ((size_t)(len) + (len) / 255 + 16) // worst case size of `len` bytes compressed
+#define LINE_WINDOW (64 << 10) // lines with tabs longer than this are drawn straight from the visible part of their text
+#define HL_SYNC_LINES 1000 // lines lexed above the screen from a guessed state when the exact one is far away
+#define HL_IDLE_LINES 65536
+#define SCREEN_MIN_SKIP 6 // unchanged cells cheaper to rewrite than to jump over
+#define ARENA_SLAB (1 << 20)
+#define LOAD_BATCH (1 << 20) // bytes the loader thread gathers before handing lines over to a busy source
+#define UNDO_BUDGET (64 << 20)
+#define UNDO_BUDGET_ENV "KILO_UNDO_MB" // overrides UNDO_BUDGET, in MB
+#define JOURNAL_BATCH (64 << 10)
+#define JOURNAL_SYNC_MS 1000 // longest time written records wait for fdatasync
+#define JOURNAL_SUFFIX ".kswp"
+#define JOURNAL_MAGIC "KILOSWP1"
+#define SAVE_BATCH 1024
+#define SAVE_SUFFIX ".XXXXXX"
+#define SCAN_MAX_THREADS 16
+#define SCAN_MIN_BYTES (4 << 20)
+#define SEARCH_MAX_THREADS 16
+#define SEARCH_MIN_LINES 65536
+#define INPUT_BUF 4096
+#define INPUT_ESC_MS 100 // wait for the rest of an escape sequence before taking ESC as a key
+#define EVENT_MAX_WATCH 8
+#define FOLLOW_POLL_MS 500 // how often a followed file is checked without inotify, or while it is rotated away
+#define PROF_SAMPLES 512
+#define PROF_TRACE_BATCH (64 << 10)
+#define PROF_TRACE_ENV "KILO_TRACE" // names the file trace events are written to
+#define BENCH_ROWS 50
+#define BENCH_COLS 160
+#define BENCH_KEYS 2000
+#define BENCH_LINES 200000 // lines of the generated document when no file is given
+#define BENCH_FOLLOW_MB 64
 
 #define CTRL_KEY(key) ((key) & 0x1F)
 
 #define VT100_CLEAR_SCREEN "\x1b[2J"
 #define VT100_CLEAR_LINE "\x1b[K"
 #define VT100_SET_CURSOR_POS "\x1b[%d;%dH"
+#define VT100_SET_CURSOR_ROW "\x1b[%dH"
 #define VT100_GET_CURSOR_POS "\x1b[6n"
 #define VT100_CURSOR_DOWN "\x1b[%dB"
 #define VT100_CURSOR_RIGHT "\x1b[%dC"
 #define VT100_CURSOR_HIDE "\x1b[?25l" // ?25 option (cursor visibility) is supported in later
 #define VT100_CURSOR_SHOW "\x1b[?25h" // VT versions, so it will not appear in VT100 docs
+#define VT100_SET_SCROLL_REGION "\x1b[%d;%dr"
+#define VT100_RESET_SCROLL_REGION "\x1b[r"
+#define VT100_INDEX "\x1b" "D"
+#define VT100_REVERSE_INDEX "\x1b" "M"
 #define VT100_INVERT_COLOR "\x1b[7m"
 #define VT100_DEFAULT_COLOR "\x1b[m"
+#define VT100_SET_COLOR "\x1b[%dm"
+#define VT100_PASTE_ON "\x1b[?2004h" // pasted text is sent between ESC[200~ and ESC[201~
+#define VT100_PASTE_OFF "\x1b[?2004l"
+#define VT100_PASTE_END "\x1b[201~"
 
 enum EditorKey {
     BACKSPACE = 127,
@@ -47,44 +112,460 @@ enum EditorKey {
     END,
 	PAGE_UP,
 	PAGE_DOWN,
+    PASTE_START,
+    PASTE_END,
 };
 
 /*** append buffer ***/
 
+long long allocations = 0; // buffers grown and blocks or slabs taken, reported by the profiling overlay
+
 struct String {
 	char* buf;
 	int len;
+	int cap;
 };
 
-#define STR_INIT { NULL, 0 }
+#define STR_INIT { NULL, 0, 0 }
+
+int StringReserve(struct String* str, int len) {
+	if (str->len + len <= str->cap) return 0;
+
+	int cap = (str->cap < 64) ? 64 : str->cap;
+	while (cap < str->len + len) cap *= 2;
+
+	char* buf = realloc(str->buf, cap);
+	if (buf == NULL) return -1;
+	++allocations;
+
+	str->buf = buf;
+	str->cap = cap;
+	return 0;
+}
 
 void StringAppend(struct String* str, const char* data, int len) {
 	if (len <= 0) return;
-	char* buf = realloc(str->buf, str->len + len);
-	if (buf == NULL) return;
+	if (StringReserve(str, len) == -1) return;
 	
-	memcpy(&buf[str->len], data, len);
-	str->buf = buf;
+	memcpy(&str->buf[str->len], data, len);
 	str->len += len;
 }
 
 void StringFree(struct String* str) {
 	free(str->buf);
+	str->buf = NULL;
     str->len = 0;
+    str->cap = 0;
 }
 
 void StringTruncate(struct String* str, int len) {
     str->len = len;
 }
 
+/*** arena ***/
+
+struct ArenaSlab {
+    struct ArenaSlab* next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct ArenaSlab* ArenaSlabNew(struct ArenaSlab** list, size_t size) {
+    struct ArenaSlab* slab = (struct ArenaSlab*)malloc(sizeof(struct ArenaSlab) + size);
+    ++allocations;
+    slab->next = *list;
+    slab->size = size;
+    slab->used = 0;
+    *list = slab;
+    return slab;
+}
+
+void ArenaFree(struct ArenaSlab** list) {
+    while (*list != NULL) {
+        struct ArenaSlab* slab = *list;
+        *list = slab->next;
+        free(slab);
+    }
+}
+
+/*** compression ***/
+
+// a byte-oriented LZ77 in the LZ4 block layout: a token holds the literal count and the match
+// length in its nibbles, 15 in either is continued by bytes of 255, then the literals, then the
+// match as a 2 byte little-endian offset back into the output; the last sequence has no match
+
+void LzPutLength(unsigned char** out, int len) {
+    for (; len >= 255; len -= 255) *(*out)++ = 255;
+    *(*out)++ = (unsigned char)len;
+}
+
+unsigned LzHash(const char* p) {
+    unsigned v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// compresses `len` bytes into `out`, which has room for LZ_BOUND(len); returns the bytes written
+int LzPack(const char* in, int len, unsigned char* out) {
+    int table[1 << LZ_HASH_BITS];
+    memset(table, -1, sizeof(table));
+    unsigned char* start = out;
+
+    int anchor = 0;
+    int i = 0;
+    int limit = len - LZ_MIN_MATCH; // the last bytes always go out as literals
+    while (i < limit) {
+        unsigned h = LzHash(&in[i]);
+        int ref = table[h];
+        table[h] = i;
+        if (ref < 0 || i - ref > 0xFFFF || memcmp(&in[ref], &in[i], LZ_MIN_MATCH) != 0) {
+            ++i;
+            continue;
+        }
+
+        int match = LZ_MIN_MATCH;
+        while (i + match < len && in[ref + match] == in[i + match]) ++match;
+
+        int literals = i - anchor;
+        int extra = match - LZ_MIN_MATCH;
+        unsigned char* token = out++;
+        *token = (unsigned char)(((literals < 15) ? literals : 15) << 4 | ((extra < 15) ? extra : 15));
+        if (literals >= 15) LzPutLength(&out, literals - 15);
+        memcpy(out, &in[anchor], literals);
+        out += literals;
+        *out++ = (unsigned char)(i - ref);
+        *out++ = (unsigned char)((i - ref) >> 8);
+        if (extra >= 15) LzPutLength(&out, extra - 15);
+
+        i += match;
+        anchor = i;
+    }
+
+    int literals = len - anchor;
+    *out++ = (unsigned char)(((literals < 15) ? literals : 15) << 4);
+    if (literals >= 15) LzPutLength(&out, literals - 15);
+    memcpy(out, &in[anchor], literals);
+    out += literals;
+    return out - start;
+}
+
+int LzGetLength(const unsigned char** in, int len) {
+    if (len < 15) return len;
+    unsigned char c;
+    do {
+        c = *(*in)++;
+        len += c;
+    } while (c == 255);
+    return len;
+}
+
+void LzUnpack(const unsigned char* in, int size, char* out, int len) {
+    const unsigned char* end = in + size;
+    char* stop = out + len;
+    while (in < end) {
+        int token = *in++;
+        int literals = LzGetLength(&in, token >> 4);
+        memcpy(out, in, literals);
+        out += literals;
+        in += literals;
+        if (in >= end || out >= stop) break;
+
+        int offset = in[0] | in[1] << 8;
+        in += 2;
+        int match = LzGetLength(&in, token & 15) + LZ_MIN_MATCH;
+        const char* from = out - offset;
+        if (offset >= match) {
+            memcpy(out, from, match);
+            out += match;
+        }
+        else {
+            // the match overlaps what it produces, repeating its start
+            for (int k = 0; k < match; ++k) *out++ = from[k];
+        }
+    }
+}
+
 /*** data ***/
 
 int startTime = 0;
 #define GET_TIME (time(NULL) - startTime)
 
+#define LINE_VIEW 0x1     // str points into the file mapping, a slab or thawed text, not its own allocation
+#define LINE_TABS 0x2     // the text may contain tabs, so it is displayed through render
+#define LINE_RENDERED 0x4 // render is up to date with the text
+#define LINE_LEXED 0x8    // hl and hlEnd are up to date with the text, for a line starting in hlStart
+
+// positions of the tabs of a line, split at the gap like the text: pos[0, before) count from the
+// start of the line and the last `after` entries of the allocation count back from its end
+struct TabIndex {
+    int before;
+    int after;
+    int cap;
+    int pos[];
+};
+
 struct EditorLine {
     struct String str;
+    int gap;
     struct String render;
+    struct TabIndex* tabs;
+    unsigned char* hl; // attribute of every byte of the text, NULL when the line isn't highlighted
+    int flags;
+    unsigned char hlStart; // lexer state the line was highlighted from
+    unsigned char hlEnd;   // lexer state carried into the next line
+};
+
+// leaf of the document: a run of consecutive lines, kept in a treap ordered by position
+// and linked in document order so neighbouring lines can be walked without a lookup
+struct LineBlock {
+    struct LineBlock* left;
+    struct LineBlock* right;
+    struct LineBlock* parent; // only meaningful below config.root
+    struct LineBlock* prev;
+    struct LineBlock* next;
+    int priority;
+    int blocks; // blocks in this subtree
+    int total;  // lines in this subtree
+    int count;  // lines in this block
+    long long bytes;      // in the lines of this block, with the newline a save writes after each
+    long long totalBytes; // in this subtree
+    struct EditorLine* line; // room for LINE_BLOCK_MAX lines, NULL while the block is cold
+    struct ColdBlock* cold;  // compressed copy, kept while hot until the lines change count
+    struct ThawText* text;   // decompressed text the view lines of a thawed block point into
+    struct LineBlock* hotPrev;
+    struct LineBlock* hotNext;
+};
+
+// the text of a block that wasn't touched for a while: either a range of the file mapping or the
+// lines compressed; data starts with the lexer state of every line and the one after the last
+struct ColdBlock {
+    size_t offset; // of the range in the mapping
+    int len;       // bytes of text
+    int packed;    // bytes of compressed text after the states, 0 for a range of the mapping
+    int raw;       // lines end in "\r*\n" as read from the file rather than in a plain "\n"
+    int states;    // lexer states stored, only while a syntax is highlighted
+    unsigned char data[];
+};
+
+// shared by the blocks a thawed block was split into, freed with the last one
+struct ThawText {
+    int refs;
+    char data[];
+};
+
+struct HotList {
+    struct LineBlock* first; // most recently touched
+    struct LineBlock* last;
+    int count;
+};
+
+struct LineIter {
+    struct LineBlock* block;
+    int index;
+};
+
+enum CellAttr {
+    ATTR_DEFAULT = 0,
+    ATTR_INVERT,
+    ATTR_COMMENT,
+    ATTR_KEYWORD,
+    ATTR_TYPE,
+    ATTR_STRING,
+    ATTR_NUMBER,
+    ATTR_PREPROC,
+};
+
+enum LexState {
+    LEX_NORMAL = 0,
+    LEX_COMMENT,
+};
+
+struct EditorSyntax {
+    const char* name;
+    const char** extensions;
+    const char** keywords; // types end with '|'
+};
+
+struct Cell {
+    char c;
+    unsigned char attr;
+};
+
+// the frame last sent to the terminal and the one being drawn, only their difference is written
+struct Screen {
+    int rows, cols;
+    struct Cell* front;
+    struct Cell* back;
+    int synced; // front is known to match what the terminal shows
+    int rowOffset; // document line shown on the top row of the front frame
+    int cursorRow, cursorCol; // -1 when the terminal cursor position is unknown
+    int attr;
+};
+
+struct SearchMatch {
+    int y, x;
+};
+
+// every occurrence of the query in the document, sorted by position
+struct SearchIndex {
+    struct SearchMatch* match;
+    int count;
+    int cap;
+    int active;
+    int current;
+    char* query;
+    int queryLen;
+    int valid;   // no edit happened since the index was built
+};
+
+struct InputBuffer {
+    char buf[INPUT_BUF];
+    int len;
+    int pos;
+};
+
+enum UndoKind {
+    UNDO_INSERT = 0,
+    UNDO_DELETE,
+};
+
+// one edit as the text it added or removed, enough to apply it in either direction
+struct UndoRecord {
+    struct UndoRecord* prev;
+    struct UndoRecord* next;
+    struct ArenaSlab* slab;
+    long long seq;
+    long long base; // seq of the state the edit was made on
+    int kind;
+    int newLine; // the edit started by appending an empty line at y
+    int y, x;
+    int len;
+    char text[]; // removed text is kept in the order it was deleted, so backspace runs read backwards
+};
+
+// the edits in the order they were made, packed into slabs that are only appended to or popped
+struct UndoLog {
+    struct ArenaSlab* slabs; // newest first
+    size_t bytes;
+    size_t budget;
+    struct UndoRecord* first; // oldest kept
+    struct UndoRecord* last;  // newest applied, NULL when everything kept is undone
+    struct UndoRecord* open;  // still taking typed or deleted characters
+    long long seq;
+    long long savedSeq;
+    int replaying;
+};
+
+// edits made since the last save, appended to a swap file next to the document so a crash doesn't lose them
+struct Journal {
+    int fd; // -1 until the first edit after opening or saving
+    char* path;
+    struct String pending;
+    long long syncTime;
+    int unsynced;
+    int replaying;
+};
+
+// identifies the version of the document the records apply to
+struct JournalHeader {
+    char magic[8];
+    long long size;
+    long long mtime;
+    long long mtimeNsec;
+};
+
+struct JournalEntry {
+    int kind;
+    int newLine;
+    int y, x;
+    int len;
+};
+
+enum ProfProbe {
+    PROF_READ = 0, // decoding a key once its first byte arrived
+    PROF_KEYS,     // EditorKeyActions, including any prompt it opens
+    PROF_SCROLL,
+    PROF_DRAW,
+    PROF_WRITE,
+    PROF_OPEN,
+    PROF_SAVE,
+    PROF_SEARCH,
+    PROF_COUNT,
+};
+
+// timings of the hot paths, only taken while the overlay is shown or a trace is written
+struct Profile {
+    int active;
+    int overlay;
+    long long sample[PROF_COUNT][PROF_SAMPLES]; // ns, the oldest overwritten first
+    int count[PROF_COUNT];
+    long long bytes;
+    int traceFd;
+    struct String trace;
+    long long traceStart;
+};
+
+enum EventTimerId {
+    TIMER_JOURNAL = 0,
+    TIMER_MESSAGE,
+    TIMER_FOLLOW,
+    TIMER_COUNT,
+};
+
+struct EventTimer {
+    long long due; // monotonic ms
+    void (*fire)(void); // NULL while disarmed
+};
+
+struct EventWatch {
+    int fd;
+    void (*ready)(void);
+};
+
+// what the editor waits on between keys: the terminal, a self-pipe woken on SIGWINCH, timers and
+// descriptors of background work
+struct EventLoop {
+    int wake[2];
+    volatile sig_atomic_t resized;
+    struct EventTimer timer[TIMER_COUNT];
+    struct EventWatch watch[EVENT_MAX_WATCH];
+    int watchCount;
+};
+
+// a block of lines read and packed by the loader thread, waiting to be added to the document
+struct LoadChunk {
+    struct LoadChunk* next;
+    struct ColdBlock* cold;
+    int count;
+    long long bytes;
+};
+
+// streams files that can't be mapped, such as pipes, on a thread of its own; the editor adds the
+// lines it hands over whenever it is woken through `notify`
+struct Loader {
+    pthread_t thread;
+    int active; // the thread runs or not everything it read has been taken
+    int fd;
+    int notify[2];
+    pthread_mutex_t lock; // guards everything below
+    pthread_cond_t cond;
+    struct LoadChunk* first;
+    struct LoadChunk* last;
+    size_t bytes;
+    int done;
+    int error;
+};
+
+// keeps appending what is written to the open file, like tail -f, while the document is read-only
+struct Follow {
+    int active;
+    int fd;     // the file followed, kept after a rotation until the name is taken by a new one
+    int notify; // inotify instance, -1 when the file is polled instead
+    int watch;
+    long long offset;
+    int open;         // the last line hasn't seen its newline yet
+    char* buf;        // read into again each time, the lines made from it are packed in between
 };
 
 struct EditorConfig {
@@ -93,25 +574,178 @@ struct EditorConfig {
 	int rows, cols;
     int rowOffset, colOffset;
     int lines;
-    struct EditorLine* line;
+    struct LineBlock* root;
+    struct LineBlock* firstBlock;
+    struct LineBlock* lastBlock;
+    struct HotList hot;
     int dirty;
     char* fileName;
+    long long fileBytes; // size of the file as the document was last read from or saved to it
+    char* map;
+    size_t mapLen;
+    size_t mapIndexed;
+    int mapFd; // kept open to notice the file being truncated underneath the mapping
+    struct timespec mapMtime;
+    long mapPage;
+    volatile sig_atomic_t mapFault; // a read past the end of the truncated file was given zeros
+    struct Loader loader;
+    struct Follow follow;
     char msg[EDITOR_MSG_LEN];
-    time_t msgTime;
+    long long msgTime; // monotonic ms
+    struct Screen screen;
+    struct SearchIndex search;
+    struct EditorSyntax* syntax;
+    int hlValid; // lines from the top whose highlighting follows from the start of the file
+    int hlDirty; // lines [hlDirty, hlKnown) are unchanged since they were below the watermark
+    int hlKnown;
+    struct InputBuffer input;
+    struct UndoLog undo;
+    struct Journal journal;
+    struct Profile prof;
+    struct EventLoop events;
 	struct termios originalTerminal;
 };
 struct EditorConfig config = { 0 };
 
+const char* cExtensions[] = { ".c", ".h", ".cpp", ".hpp", ".cc", NULL };
+const char* cKeywords[] = {
+    "switch", "if", "while", "for", "break", "continue", "return", "else", "struct", "union", "typedef",
+    "static", "enum", "class", "case", "default", "do", "goto", "sizeof", "extern", "const", "volatile",
+    "inline", "NULL",
+    "int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|", "void|", "short|", "size_t|",
+    "bool|", NULL
+};
+
+struct EditorSyntax syntaxes[] = {
+    { "c", cExtensions, cKeywords },
+};
+
 /*** prototypes ***/
 
 void EditorSetMessage(const char* fmt, ...);
+void SearchInvalidate(void);
+int EditorIndexMapping(size_t bytes);
+void HighlightInvalidate(int y);
+void HighlightShift(int at, int delta);
+void BlockThaw(struct LineBlock* block);
+void ColdEvict(void);
+int HighlightPending(void);
+int HighlightIdle(void);
+void EditorRefreshScreen(void);
+int EditorDecodeKey(int c);
+long long MonotonicMs(void);
+int EventWait(int timeoutMs);
+void EventSetTimer(int timer, long long due, void (*fire)(void));
 char* EditorPrompt(char* prompt, void (*callback)(char*, int));
+void JournalRecord(int kind, int newLine, int y, int x, const char* text, int len);
+void JournalCommit(void);
+void JournalTick(void);
+void JournalReplay(void);
+void JournalDiscard(void);
+void EditorCheckMapping(void);
+#ifdef EDITOR_BENCH
+void BenchCapture(const char* buf, int len);
+int BenchNextKey(void);
+#endif
+
+/*** profiling ***/
+
+const char* profNames[PROF_COUNT] = { "read", "keys", "scroll", "draw", "write", "open", "save", "search" };
+
+long long ProfNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// returns 0 when profiling is off, so a disabled probe costs a branch and no clock read
+long long ProfBegin(void) {
+    return config.prof.active ? ProfNow() : 0;
+}
+
+void ProfFlush(void) {
+    struct Profile* prof = &config.prof;
+    if (prof->traceFd == -1 || prof->trace.len == 0) return;
+    write(prof->traceFd, prof->trace.buf, prof->trace.len);
+    StringTruncate(&prof->trace, 0);
+}
+
+void ProfTraceEvent(const char* fmt, ...) {
+    struct Profile* prof = &config.prof;
+    char event[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(event, sizeof(event), fmt, ap);
+    va_end(ap);
+    if (len >= (int)sizeof(event)) len = sizeof(event) - 1;
+
+    StringAppend(&prof->trace, event, len);
+    if (prof->trace.len >= PROF_TRACE_BATCH) ProfFlush();
+}
+
+void ProfEnd(int probe, long long start) {
+    if (start == 0) return;
+    struct Profile* prof = &config.prof;
+    long long end = ProfNow();
+    prof->sample[probe][prof->count[probe]++ % PROF_SAMPLES] = end - start;
+    if (prof->traceFd == -1) return;
+
+    double ts = (start - prof->traceStart) / 1e3;
+    ProfTraceEvent("{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1},\n",
+            profNames[probe], ts, (end - start) / 1e3);
+    if (probe == PROF_WRITE) {
+        ProfTraceEvent("{\"name\":\"counters\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"bytes\":%lld,\"allocations\":%lld}},\n",
+                ts, prof->bytes, allocations);
+    }
+}
+
+// the trace is a Chrome trace-event JSON array, whose closing bracket the viewers treat as optional
+void ProfOpenTrace(const char* path) {
+    struct Profile* prof = &config.prof;
+    prof->traceFd = -1;
+    if (path == NULL || path[0] == '\0') return;
+
+    prof->traceFd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (prof->traceFd == -1) return;
+    prof->traceStart = ProfNow();
+    prof->active = 1;
+    StringAppend(&prof->trace, "[\n", 2);
+    atexit(ProfFlush);
+}
+
+void ProfToggleOverlay(void) {
+    struct Profile* prof = &config.prof;
+    prof->overlay = !prof->overlay;
+    prof->active = prof->overlay || prof->traceFd != -1;
+}
+
+int ProfCompare(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+int ProfFormat(char* buf, int size) {
+    struct Profile* prof = &config.prof;
+    int len = snprintf(buf, size, "out %lldK alloc %lld |", prof->bytes >> 10, allocations);
+    long long sorted[PROF_SAMPLES];
+    for (int probe = 0; probe < PROF_COUNT && len < size; ++probe) {
+        int count = (prof->count[probe] < PROF_SAMPLES) ? prof->count[probe] : PROF_SAMPLES;
+        if (count == 0) continue;
+
+        memcpy(sorted, prof->sample[probe], count * sizeof(long long));
+        qsort(sorted, count, sizeof(long long), ProfCompare);
+        len += snprintf(&buf[len], size - len, " %s %lld/%lldus", profNames[probe],
+                sorted[count / 2] / 1000, sorted[count * 99 / 100] / 1000);
+    }
+    return (len < size) ? len : size - 1;
+}
 
 /*** terminal ***/
 
 void TerminalSetCursor(struct String* term, int row, int col) {
 	char cmd[16] = { 0 };
-	int length = snprintf(cmd, 16, VT100_SET_CURSOR_POS, row, col);
+	int length = (col == 1) ? snprintf(cmd, 16, VT100_SET_CURSOR_ROW, row) : snprintf(cmd, 16, VT100_SET_CURSOR_POS, row, col);
 	StringAppend(term, cmd, length);
 }
 
@@ -152,17 +786,80 @@ void TerminalDefaultColor(struct String* term) {
 	StringAppend(term, VT100_DEFAULT_COLOR, sizeof(VT100_DEFAULT_COLOR) - 1);
 }
 
+// scrolls rows [top, bottom] (1-based) by `lines`, up when positive, leaving the cursor at 1;1
+void TerminalScrollRegion(struct String* term, int top, int bottom, int lines) {
+	char cmd[16] = { 0 };
+	int length = snprintf(cmd, 16, VT100_SET_SCROLL_REGION, top, bottom);
+	StringAppend(term, cmd, length);
+
+    if (lines > 0) {
+        TerminalSetCursor(term, bottom, 1);
+        for (int i = 0; i < lines; ++i) StringAppend(term, VT100_INDEX, sizeof(VT100_INDEX) - 1);
+    }
+    else {
+        TerminalSetCursor(term, top, 1);
+        for (int i = 0; i < -lines; ++i) StringAppend(term, VT100_REVERSE_INDEX, sizeof(VT100_REVERSE_INDEX) - 1);
+    }
+	StringAppend(term, VT100_RESET_SCROLL_REGION, sizeof(VT100_RESET_SCROLL_REGION) - 1);
+}
+
+void TerminalSetColor(struct String* term, int color) {
+	char cmd[16] = { 0 };
+	int length = snprintf(cmd, 16, VT100_SET_COLOR, color);
+	StringAppend(term, cmd, length);
+}
+
+void TerminalSetAttr(struct String* term, int attr) {
+    static const int colors[] = { 0, 0, 36, 33, 32, 35, 31, 34 };
+
+    TerminalDefaultColor(term);
+    if (attr == ATTR_INVERT) TerminalInvertColor(term);
+    else if (attr != ATTR_DEFAULT) TerminalSetColor(term, colors[attr]);
+}
+
+// moves the cursor with the shortest sequence, positions are 0-based and `fromCol` is -1 when unknown
+void TerminalMoveCursor(struct String* term, int fromRow, int fromCol, int toRow, int toCol) {
+    if (fromCol >= 0 && fromRow == toRow) {
+        if (fromCol == toCol) return;
+        if (toCol == 0) {
+            StringAppend(term, "\r", 1);
+            return;
+        }
+        if (toCol > fromCol) {
+            TerminalMoveCursorRight(term, toCol - fromCol);
+            return;
+        }
+    }
+    TerminalSetCursor(term, toRow + 1, toCol + 1);
+}
+
+// every frame goes through here, so the benchmark build can keep them in memory instead
+void TerminalWrite(struct String* term) {
+    config.prof.bytes += term->len;
+#ifdef EDITOR_BENCH
+    BenchCapture(term->buf, term->len);
+#else
+	write(STDOUT_FILENO, term->buf, term->len);
+#endif
+}
+
 void Die(const char* name) {
 	struct String str = STR_INIT;
 	TerminalClear(&str);
-	write(STDOUT_FILENO, str.buf, str.len);
+	TerminalWrite(&str);
 	StringFree(&str);
+    JournalCommit();
 
 	perror(name);
 	exit(1);
 }
 
 void DisableRawMode(void) {
+	struct String str = STR_INIT;
+	StringAppend(&str, VT100_PASTE_OFF, sizeof(VT100_PASTE_OFF) - 1);
+	TerminalWrite(&str);
+	StringFree(&str);
+
 	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &config.originalTerminal) == -1) {
 		Die("tcsetattr");
 	}
@@ -180,31 +877,88 @@ void EnableRawMode(void) {
 	raw.c_cflag |= (CS8);
 	raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
 	raw.c_cc[VMIN] = 0;
-	raw.c_cc[VTIME] = 1; // 100 miliseconds
+	raw.c_cc[VTIME] = 0; // reads never block, waiting is done by the event loop
 
 	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) {
 		Die("tcsetattr");
 	}
+
+	struct String str = STR_INIT;
+	StringAppend(&str, VT100_PASTE_ON, sizeof(VT100_PASTE_ON) - 1);
+	TerminalWrite(&str);
+	StringFree(&str);
+}
+
+int EditorInputPending(void) {
+    if (config.input.pos < config.input.len) return 1;
+    struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+    return poll(&fd, 1, 0) > 0;
+}
+
+// takes everything the terminal has sent so far with one read, waiting up to `timeoutMs` (-1 for ever) for the first byte
+int InputFill(int timeoutMs) {
+    struct InputBuffer* in = &config.input;
+    in->pos = 0;
+    in->len = 0;
+    if (EventWait(timeoutMs) == 0) return 0;
+
+    int bytesRead = read(STDIN_FILENO, in->buf, INPUT_BUF);
+    if (bytesRead == -1 && errno != EAGAIN && errno != EINTR) {
+        Die("read");
+    }
+    // readable but empty means the terminal hung up
+    if (bytesRead == 0) {
+        errno = EIO;
+        Die("read");
+    }
+    in->len = (bytesRead > 0) ? bytesRead : 0;
+    return in->len;
+}
+
+int InputByte(char* c, int timeoutMs) {
+    struct InputBuffer* in = &config.input;
+    if (in->pos == in->len && InputFill(timeoutMs) == 0) return 0;
+    *c = in->buf[in->pos++];
+    return 1;
 }
 
 int EditorReadKey(void) {
-	int bytesRead = 0;
-	int c = 0;
-	while ((bytesRead = read(STDIN_FILENO, &c, 1)) != 1) {
-		if (bytesRead == -1 && errno != EAGAIN) {
-			Die("read");
-		}
-	}
+#ifdef EDITOR_BENCH
+    return BenchNextKey();
+#else
+	char byte = 0;
+    // keep splitting the mapped file into lines and highlighting it while the user is idle
+    while ((config.mapIndexed < config.mapLen || HighlightPending()) && !EditorInputPending()) {
+        if (config.mapIndexed < config.mapLen) EditorIndexMapping(EDITOR_INDEX_CHUNK);
+        else if (HighlightIdle()) EditorRefreshScreen();
+    }
+    if (config.prof.traceFd != -1 && !EditorInputPending()) ProfFlush();
+	while (InputByte(&byte, -1) == 0);
+    EditorCheckMapping();
+
+    long long start = ProfBegin();
+    int key = EditorDecodeKey((unsigned char)byte);
+    ProfEnd(PROF_READ, start);
+    return key;
+#endif
+}
 
+int EditorDecodeKey(int c) {
 	if (c == '\x1b') {
-		char seq[3];
-		if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-		if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
+		char seq[5];
+		if (InputByte(&seq[0], INPUT_ESC_MS) == 0) return '\x1b';
+		if (InputByte(&seq[1], INPUT_ESC_MS) == 0) return '\x1b';
 
 		if (seq[0] == '[') {
 			if (seq[1] >= '0' && seq[1] <= '9') {
-				if (read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
-				if (seq[2] == '~') {
+				if (InputByte(&seq[2], INPUT_ESC_MS) == 0) return '\x1b';
+				if (seq[2] >= '0' && seq[2] <= '9') {
+					if (InputByte(&seq[3], INPUT_ESC_MS) == 0) return '\x1b';
+					if (InputByte(&seq[4], INPUT_ESC_MS) == 0) return '\x1b';
+					if (memcmp(seq, "[200~", 5) == 0) return PASTE_START;
+					if (memcmp(seq, "[201~", 5) == 0) return PASTE_END;
+				}
+				else if (seq[2] == '~') {
 					switch (seq[1]) {
                         case '1': return HOME;
                         case '3': return DELETE;
@@ -245,7 +999,7 @@ int GetCursorPosition(int* rows, int* cols) {
 	char buf[16];
 	int i = 0;
 	while (i < (int)sizeof(buf) -1) {
-		if (read(STDIN_FILENO, &buf[i], 1) != 1) break;
+		if (InputByte(&buf[i], INPUT_ESC_MS) == 0) break;
 		if (buf[i] == 'R') break;
 		++i;
   	}
@@ -267,7 +1021,7 @@ int GetTerminalSize(int* rows, int* cols) {
 		TerminalMoveCursorRight(&str, 999);
 		if (write(STDOUT_FILENO, str.buf, str.len) != str.len) return -1;
 		StringFree(&str);
-		return GetCursorPosition(&config.rows, &config.cols);
+		return GetCursorPosition(rows, cols);
 	}
 	else {
 		*rows = ws.ws_row;
@@ -276,286 +1030,3378 @@ int GetTerminalSize(int* rows, int* cols) {
 	return 0;
 }
 
-/*** line operations ***/
+/*** screen ***/
 
-int GetRenderOffset(struct EditorLine* line, int x) {
-    int renderOffset = 0;
-    for (int i = 0; i < x; ++i) {
-        if (line->str.buf[i] == '\t') {
-            renderOffset += EDITOR_TAB_LEN;
-        }
-        else {
-            ++renderOffset;
-        }
+void ScreenResize(int rows, int cols) {
+    struct Screen* screen = &config.screen;
+    screen->rows = rows;
+    screen->cols = cols;
+    screen->front = realloc(screen->front, rows * cols * sizeof(struct Cell));
+    screen->back = realloc(screen->back, rows * cols * sizeof(struct Cell));
+    screen->synced = 0;
+}
+
+void ScreenDrawRow(int row, const char* buf, int len, int attr) {
+    struct Screen* screen = &config.screen;
+    struct Cell* cell = &screen->back[row * screen->cols];
+    if (len > screen->cols) len = screen->cols;
+
+    for (int i = 0; i < len; ++i) {
+        cell[i].c = buf[i];
+        cell[i].attr = attr;
+    }
+    for (int i = len; i < screen->cols; ++i) {
+        cell[i].c = ' ';
+        cell[i].attr = ATTR_DEFAULT;
     }
-    return renderOffset;
 }
 
-int GetLineIndex(struct EditorLine* line, int renderOffset) {
-    int currOffset = 0;
-    for (int i = 0; i < line->str.len; ++i) {
-        if (line->str.buf[i] == '\t') {
-            currOffset += EDITOR_TAB_LEN;
+void ScreenDrawCells(int row, const char* buf, const unsigned char* attr, int len) {
+    ScreenDrawRow(row, buf, len, ATTR_DEFAULT);
+    struct Cell* cell = &config.screen.back[row * config.screen.cols];
+    if (len > config.screen.cols) len = config.screen.cols;
+    for (int i = 0; i < len; ++i) cell[i].attr = attr[i];
+}
+
+int CellEqual(struct Cell* a, struct Cell* b) {
+    return a->c == b->c && a->attr == b->attr;
+}
+
+int CellBlank(struct Cell* cell) {
+    return cell->c == ' ' && cell->attr == ATTR_DEFAULT;
+}
+
+void ScreenFlushRow(struct String* term, int row) {
+    struct Screen* screen = &config.screen;
+    struct Cell* front = &screen->front[row * screen->cols];
+    struct Cell* back = &screen->back[row * screen->cols];
+
+    // a changed blank tail is cleared with one erase instead of written out
+    int end = screen->cols;
+    while (end > 0 && CellBlank(&back[end - 1])) --end;
+
+    // cells hold bytes, so once a multibyte character is on the row the terminal columns no longer
+    // line up with them and a changed row is written again from its start
+    int multibyte = 0;
+    for (int i = 0; i < screen->cols && !multibyte; ++i) {
+        multibyte = (back[i].c & 0x80) || (front[i].c & 0x80);
+    }
+
+    int col = 0;
+    while (col < screen->cols) {
+        while (col < screen->cols && CellEqual(&front[col], &back[col])) ++col;
+        if (col == screen->cols) break;
+        if (multibyte) col = 0;
+
+        TerminalMoveCursor(term, screen->cursorRow, screen->cursorCol, row, col);
+        screen->cursorRow = row;
+        screen->cursorCol = col;
+
+        if (col >= end) {
+            if (screen->attr != ATTR_DEFAULT) TerminalSetAttr(term, ATTR_DEFAULT);
+            screen->attr = ATTR_DEFAULT;
+            TerminalClearLine(term);
+            break;
         }
-        else {
-            ++currOffset;
+
+        // short runs of unchanged cells are rewritten rather than skipped with a cursor move
+        int spanEnd = multibyte ? end : col + 1;
+        for (int i = spanEnd; i < end && i - spanEnd < SCREEN_MIN_SKIP; ++i) {
+            if (!CellEqual(&front[i], &back[i])) spanEnd = i + 1;
         }
 
-        if (currOffset > renderOffset) return i;
+        for (int i = col; i < spanEnd; ++i) {
+            if (back[i].attr != screen->attr) {
+                TerminalSetAttr(term, back[i].attr);
+                screen->attr = back[i].attr;
+            }
+            StringAppend(term, &back[i].c, 1);
+        }
+        col = spanEnd;
+        // the cursor sits in the pending-wrap state after the last column
+        screen->cursorCol = (col == screen->cols) ? -1 : col;
+        if (multibyte) {
+            if (screen->attr != ATTR_DEFAULT) TerminalSetAttr(term, ATTR_DEFAULT);
+            screen->attr = ATTR_DEFAULT;
+            if (col < screen->cols) TerminalClearLine(term);
+            screen->cursorCol = -1;
+            break;
+        }
     }
-    return line->str.len - 1;
+
+    memcpy(front, back, screen->cols * sizeof(struct Cell));
 }
 
-void EditorUpdateLine(struct EditorLine* line) {
-    free(line->render.buf);
-    line->render.buf = NULL;
-    line->render.len = 0;
-    
-    for (int i = 0; i < line->str.len; ++i) {
-        if (line->str.buf[i] == '\t') {
-            StringAppend(&line->render, EDITOR_TAB, EDITOR_TAB_LEN);
-        }
-        else {
-            StringAppend(&line->render, &line->str.buf[i], 1);
-        }
+// when the first `rows` rows of the new frame are the old ones shifted by `lines`, moves them
+// on the terminal with a scroll region so only the newly exposed rows have to be written
+void ScreenScroll(struct String* term, int rows, int lines) {
+    struct Screen* screen = &config.screen;
+    if (!screen->synced || lines == 0 || lines >= rows || -lines >= rows) return;
+
+    int cols = screen->cols;
+    int size = cols * sizeof(struct Cell);
+    int kept = 0;
+    int shifted = 0;
+    for (int row = 0; row < rows; ++row) {
+        struct Cell* back = &screen->back[row * cols];
+        if (memcmp(back, &screen->front[row * cols], size) == 0) ++kept;
+        if (row + lines >= 0 && row + lines < rows && memcmp(back, &screen->front[(row + lines) * cols], size) == 0) ++shifted;
+    }
+    if (shifted <= kept) return;
+
+    if (screen->attr != ATTR_DEFAULT) TerminalSetAttr(term, ATTR_DEFAULT);
+    screen->attr = ATTR_DEFAULT;
+    TerminalScrollRegion(term, 1, rows, lines);
+    screen->cursorRow = 0;
+    screen->cursorCol = 0;
+
+    int moved = rows - ((lines > 0) ? lines : -lines);
+    struct Cell* blank = screen->front;
+    if (lines > 0) {
+        memmove(screen->front, &screen->front[lines * cols], moved * size);
+        blank = &screen->front[moved * cols];
+    }
+    else {
+        memmove(&screen->front[-lines * cols], screen->front, moved * size);
+    }
+    for (int i = 0; i < (rows - moved) * cols; ++i) {
+        blank[i].c = ' ';
+        blank[i].attr = ATTR_DEFAULT;
     }
-    // char status[64];
-    // int len = snprintf(status, sizeof(status), "[len: %d | upt: %ld]", line->str.len, GET_TIME);
-    // StringAppend(&line->render, status, len); 
 }
 
-void EditorInsertLine(char* buf, int len, int at) {
-    if (at < 0 || at > config.lines) return;
+void ScreenFlush(struct String* term, int cursorRow, int cursorCol) {
+    struct Screen* screen = &config.screen;
+    int size = screen->rows * screen->cols;
 
-    config.line = realloc(config.line, (config.lines + 1) * sizeof(struct EditorLine));
-    if (at != config.lines) {
-        memmove(&config.line[at + 1], &config.line[at], (config.lines - at) * sizeof(struct EditorLine)); 
+    if (!screen->synced) {
+        TerminalSetAttr(term, ATTR_DEFAULT);
+        TerminalClear(term);
+        for (int i = 0; i < size; ++i) {
+            screen->front[i].c = ' ';
+            screen->front[i].attr = ATTR_DEFAULT;
+        }
+        screen->attr = ATTR_DEFAULT;
+        screen->cursorRow = 0;
+        screen->cursorCol = 0;
+        screen->synced = 1;
+    }
+
+    if (memcmp(screen->front, screen->back, size * sizeof(struct Cell)) != 0) {
+        TerminalHideCursor(term);
+        for (int row = 0; row < screen->rows; ++row) {
+            ScreenFlushRow(term, row);
+        }
+        if (screen->attr != ATTR_DEFAULT) TerminalSetAttr(term, ATTR_DEFAULT);
+        screen->attr = ATTR_DEFAULT;
+        TerminalMoveCursor(term, screen->cursorRow, screen->cursorCol, cursorRow, cursorCol);
+        TerminalShowCursor(term);
     }
+    else {
+        TerminalMoveCursor(term, screen->cursorRow, screen->cursorCol, cursorRow, cursorCol);
+    }
+    screen->cursorRow = cursorRow;
+    screen->cursorCol = cursorCol;
+}
 
-    struct EditorLine* line = &config.line[at];
+/*** event loop ***/
 
-    line->str.buf = (char*)malloc(len);
-    memcpy(line->str.buf, buf, len);
-    line->str.len = len;
+long long MonotonicMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
 
-    line->render.buf = NULL;
-    EditorUpdateLine(line);
+void EventOnResize(int sig) {
+    (void)sig;
+    int saved = errno;
+    config.events.resized = 1;
+    write(config.events.wake[1], "", 1);
+    errno = saved;
+}
 
-    ++config.lines;
+void EventInit(void) {
+    struct EventLoop* loop = &config.events;
+    if (pipe(loop->wake) == -1) Die("pipe");
+    for (int i = 0; i < 2; ++i) {
+        fcntl(loop->wake[i], F_SETFL, O_NONBLOCK);
+        fcntl(loop->wake[i], F_SETFD, FD_CLOEXEC);
+    }
 
-    ++config.dirty;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = EventOnResize;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGWINCH, &sa, NULL) == -1) Die("sigaction");
 }
 
-void EditorFreeLine(struct EditorLine* line) {
-    StringFree(&line->str);
-    StringFree(&line->render);
+void EventSetTimer(int timer, long long due, void (*fire)(void)) {
+    config.events.timer[timer].due = due;
+    config.events.timer[timer].fire = fire;
 }
 
-void EditorDeleteLine(int at) {
-    if (at < 0 || at >= config.lines) return;
-    
-    EditorFreeLine(&config.line[at]);
-    memmove(&config.line[at], &config.line[at + 1], (config.lines - at - 1) * sizeof(struct EditorLine));
-    --config.lines;
-    
-    ++config.dirty;
+void EventWatch(int fd, void (*ready)(void)) {
+    struct EventLoop* loop = &config.events;
+    if (loop->watchCount == EVENT_MAX_WATCH) return;
+    loop->watch[loop->watchCount].fd = fd;
+    loop->watch[loop->watchCount].ready = ready;
+    ++loop->watchCount;
 }
 
-void EditorLineInsertChar(struct EditorLine* line, int at, char c) {
-    struct String* str = &line->str;
-    if (at < 0 || at > str->len) at = str->len;
+void EventUnwatch(int fd) {
+    struct EventLoop* loop = &config.events;
+    for (int i = 0; i < loop->watchCount; ++i) {
+        if (loop->watch[i].fd == fd) {
+            loop->watch[i] = loop->watch[--loop->watchCount];
+            return;
+        }
+    }
+}
 
-    str->buf = realloc(str->buf, str->len + 1);
-    memmove(&str->buf[at + 1], &str->buf[at], str->len - at);  
-    ++str->len;
+void EditorResize(void) {
+    int rows, cols;
+    if (GetTerminalSize(&rows, &cols) == -1 || rows < 3) return;
 
-    str->buf[at] = c;
+    ScreenResize(rows, cols);
+    config.rows = rows - 2;
+    config.cols = cols;
+    EditorRefreshScreen();
+}
 
-    EditorUpdateLine(line);
-    ++config.dirty;
+// fires every timer that is due, returns the earliest deadline still armed or -1
+long long EventFireTimers(void) {
+    struct EventLoop* loop = &config.events;
+    long long next = -1;
+    for (int i = 0; i < TIMER_COUNT; ++i) {
+        struct EventTimer* timer = &loop->timer[i];
+        if (timer->fire != NULL && timer->due <= MonotonicMs()) {
+            void (*fire)(void) = timer->fire;
+            timer->fire = NULL;
+            fire();
+        }
+        if (timer->fire != NULL && (next == -1 || timer->due < next)) next = timer->due;
+    }
+    return next;
 }
 
-void EditorLineAppendString(struct EditorLine* line, struct String* str) {
-    StringAppend(&line->str, str->buf, str->len);
-    EditorUpdateLine(line);
+// blocks without spinning until the terminal has input or `timeoutMs` passed (-1 waits for ever),
+// handling resizes, timers and watched descriptors in the meantime; returns 1 when input is ready
+int EventWait(int timeoutMs) {
+    struct EventLoop* loop = &config.events;
+    long long deadline = (timeoutMs < 0) ? -1 : MonotonicMs() + timeoutMs;
+    while (1) {
+        if (loop->resized) {
+            loop->resized = 0;
+            EditorResize();
+        }
+        long long wake = EventFireTimers();
+        if (deadline != -1 && (wake == -1 || deadline < wake)) wake = deadline;
+
+        long long now = MonotonicMs();
+        int wait = (wake == -1) ? -1 : (wake > now) ? (int)(wake - now) : 0;
+
+        struct pollfd fds[2 + EVENT_MAX_WATCH];
+        fds[0] = (struct pollfd){ STDIN_FILENO, POLLIN, 0 };
+        fds[1] = (struct pollfd){ loop->wake[0], POLLIN, 0 };
+        int count = 2;
+        for (int i = 0; i < loop->watchCount; ++i) {
+            fds[count++] = (struct pollfd){ loop->watch[i].fd, POLLIN, 0 };
+        }
+
+        if (poll(fds, count, wait) == -1) {
+            if (errno == EINTR) continue;
+            Die("poll");
+        }
+        if (fds[1].revents) {
+            char drain[64];
+            while (read(loop->wake[0], drain, sizeof(drain)) > 0);
+        }
+        // a callback may unwatch descriptors, so each is looked up again before it is called
+        for (int i = 2; i < count; ++i) {
+            if (fds[i].revents == 0) continue;
+            for (int j = 0; j < loop->watchCount; ++j) {
+                if (loop->watch[j].fd == fds[i].fd) {
+                    loop->watch[j].ready();
+                    break;
+                }
+            }
+        }
+        if (fds[0].revents) return 1;
+        if (deadline != -1 && MonotonicMs() >= deadline) return 0;
+    }
+}
+
+/*** document ***/
+
+int BlockTotal(struct LineBlock* block) {
+    return (block == NULL) ? 0 : block->total;
+}
+
+int BlockCount(struct LineBlock* block) {
+    return (block == NULL) ? 0 : block->blocks;
+}
+
+long long BlockTotalBytes(struct LineBlock* block) {
+    return (block == NULL) ? 0 : block->totalBytes;
+}
+
+void BlockUpdate(struct LineBlock* block) {
+    block->total = block->count + BlockTotal(block->left) + BlockTotal(block->right);
+    block->blocks = 1 + BlockCount(block->left) + BlockCount(block->right);
+    block->totalBytes = block->bytes + BlockTotalBytes(block->left) + BlockTotalBytes(block->right);
+    if (block->left != NULL) block->left->parent = block;
+    if (block->right != NULL) block->right->parent = block;
+}
+
+void BlockSplit(struct LineBlock* tree, int rank, struct LineBlock** left, struct LineBlock** right) {
+    if (tree == NULL) {
+        *left = NULL;
+        *right = NULL;
+        return;
+    }
+
+    if (rank <= BlockCount(tree->left)) {
+        BlockSplit(tree->left, rank, left, &tree->left);
+        *right = tree;
+    }
+    else {
+        BlockSplit(tree->right, rank - BlockCount(tree->left) - 1, &tree->right, right);
+        *left = tree;
+    }
+    BlockUpdate(tree);
+}
+
+struct LineBlock* BlockMerge(struct LineBlock* left, struct LineBlock* right) {
+    if (left == NULL) return right;
+    if (right == NULL) return left;
+
+    if (left->priority > right->priority) {
+        left->right = BlockMerge(left->right, right);
+        BlockUpdate(left);
+        return left;
+    }
+    right->left = BlockMerge(left, right->left);
+    BlockUpdate(right);
+    return right;
+}
+
+// adds `delta` lines to the block at `rank` and to every subtree total above it
+void BlockAdjust(int rank, int delta) {
+    struct LineBlock* node = config.root;
+    while (node != NULL) {
+        node->total += delta;
+
+        int leftBlocks = BlockCount(node->left);
+        if (rank < leftBlocks) {
+            node = node->left;
+        }
+        else if (rank == leftBlocks) {
+            node->count += delta;
+            return;
+        }
+        else {
+            rank -= leftBlocks + 1;
+            node = node->right;
+        }
+    }
+}
+
+// the hot blocks are listed from the most to the least recently touched
+void HotLink(struct LineBlock* block, int front) {
+    struct HotList* hot = &config.hot;
+    block->hotPrev = front ? NULL : hot->last;
+    block->hotNext = front ? hot->first : NULL;
+    if (block->hotPrev != NULL) block->hotPrev->hotNext = block;
+    else hot->first = block;
+    if (block->hotNext != NULL) block->hotNext->hotPrev = block;
+    else hot->last = block;
+    ++hot->count;
+}
+
+void HotUnlink(struct LineBlock* block) {
+    struct HotList* hot = &config.hot;
+    if (block->hotPrev != NULL) block->hotPrev->hotNext = block->hotNext;
+    else hot->first = block->hotNext;
+    if (block->hotNext != NULL) block->hotNext->hotPrev = block->hotPrev;
+    else hot->last = block->hotPrev;
+    --hot->count;
+}
+
+void HotTouch(struct LineBlock* block) {
+    if (config.hot.first == block) return;
+    HotUnlink(block);
+    HotLink(block, 1);
+}
+
+void ThawRelease(struct ThawText* text) {
+    if (text != NULL && --text->refs == 0) free(text);
+}
+
+// a block starts out cold, with no room for lines until it is heated
+struct LineBlock* BlockNew(int count) {
+    struct LineBlock* block = (struct LineBlock*)malloc(sizeof(struct LineBlock));
+    ++allocations;
+    block->left = NULL;
+    block->right = NULL;
+    block->priority = rand();
+    block->count = count;
+    block->bytes = 0;
+    block->line = NULL;
+    block->cold = NULL;
+    block->text = NULL;
+    BlockUpdate(block);
+    return block;
+}
+
+// gives the block room for its lines, as the most recently touched or as the next to be frozen
+void BlockHeat(struct LineBlock* block, int front) {
+    block->line = (struct EditorLine*)malloc(LINE_BLOCK_MAX * sizeof(struct EditorLine));
+    ++allocations;
+    HotLink(block, front);
+}
+
+void BlockResize(struct LineBlock* block) {
+    long long bytes = block->count;
+    for (int i = 0; i < block->count; ++i) bytes += block->line[i].str.len;
+
+    long long delta = bytes - block->bytes;
+    block->bytes = bytes;
+    for (struct LineBlock* node = block; delta != 0; node = node->parent) {
+        node->totalBytes += delta;
+        if (node == config.root) break;
+    }
+}
+
+// the hot block holding `line`, which is nearly always the one looked up last
+struct LineBlock* BlockOfLine(struct EditorLine* line) {
+    for (struct LineBlock* block = config.hot.first; block != NULL; block = block->hotNext) {
+        if (line >= block->line && line < &block->line[block->count]) return block;
+    }
+    return NULL;
+}
+
+// the compressed copy no longer matches once lines come or go
+void BlockChanged(struct LineBlock* block) {
+    free(block->cold);
+    block->cold = NULL;
+}
+
+// frees the block along with whatever holds its text, but not the contents of its lines
+void BlockFree(struct LineBlock* block) {
+    if (block->line != NULL) HotUnlink(block);
+    free(block->line);
+    free(block->cold);
+    ThawRelease(block->text);
+    free(block);
+}
+
+void BlockLink(struct LineBlock* block, struct LineBlock* prev) {
+    block->prev = prev;
+    block->next = (prev == NULL) ? config.firstBlock : prev->next;
+    if (block->prev != NULL) block->prev->next = block;
+    else config.firstBlock = block;
+    if (block->next != NULL) block->next->prev = block;
+    else config.lastBlock = block;
+}
+
+void BlockUpdateTree(struct LineBlock* tree) {
+    if (tree == NULL) return;
+    BlockUpdateTree(tree->left);
+    BlockUpdateTree(tree->right);
+    BlockUpdate(tree);
+}
+
+struct LineBlock* BlockInsert(struct LineBlock* prev, int rank) {
+    struct LineBlock* block = BlockNew(0);
+    BlockHeat(block, 1);
+    BlockLink(block, prev);
+
+    struct LineBlock* left = NULL;
+    struct LineBlock* right = NULL;
+    BlockSplit(config.root, rank, &left, &right);
+    config.root = BlockMerge(BlockMerge(left, block), right);
+    ColdEvict();
+    return block;
+}
+
+void BlockRemove(struct LineBlock* block, int rank) {
+    struct LineBlock* left = NULL;
+    struct LineBlock* mid = NULL;
+    struct LineBlock* right = NULL;
+    BlockSplit(config.root, rank, &left, &mid);
+    BlockSplit(mid, 1, &mid, &right);
+    config.root = BlockMerge(left, right);
+
+    if (block->prev != NULL) block->prev->next = block->next;
+    else config.firstBlock = block->next;
+    if (block->next != NULL) block->next->prev = block->prev;
+    else config.lastBlock = block->prev;
+    BlockFree(block);
+}
+
+struct LineBlock* BlockLocate(int at, int* rank, int* index) {
+    struct LineBlock* node = config.root;
+    int blocks = 0;
+    while (node != NULL) {
+        int leftLines = BlockTotal(node->left);
+        if (at < leftLines) {
+            node = node->left;
+        }
+        else if (at < leftLines + node->count) {
+            *rank = blocks + BlockCount(node->left);
+            *index = at - leftLines;
+            return node;
+        }
+        else {
+            at -= leftLines + node->count;
+            blocks += BlockCount(node->left) + 1;
+            node = node->right;
+        }
+    }
+    return NULL;
+}
+
+struct EditorLine* DocumentLine(int at) {
+    if (at < 0 || at >= config.lines) return NULL;
+
+    int rank, index;
+    struct LineBlock* block = BlockLocate(at, &rank, &index);
+    BlockThaw(block);
+    return &block->line[index];
+}
+
+// opens an uninitialized slot for a line at `at`, pointers to other lines may be invalidated
+struct EditorLine* DocumentInsertLine(int at) {
+    struct LineBlock* block = NULL;
+    int rank, index;
+    if (at == config.lines) {
+        block = config.lastBlock;
+        rank = BlockCount(config.root) - 1;
+        index = (block == NULL) ? 0 : block->count;
+        if (block != NULL) BlockThaw(block);
+        if (block == NULL || block->count == LINE_BLOCK_MAX) {
+            block = BlockInsert(block, ++rank);
+            index = 0;
+        }
+    }
+    else {
+        block = BlockLocate(at, &rank, &index);
+        BlockThaw(block);
+        if (block->count == LINE_BLOCK_MAX) {
+            // move the upper half into a new block right after this one, its views share the thawed text
+            int half = LINE_BLOCK_MAX / 2;
+            struct LineBlock* next = BlockInsert(block, rank + 1);
+            memcpy(next->line, &block->line[half], (LINE_BLOCK_MAX - half) * sizeof(struct EditorLine));
+            next->text = block->text;
+            if (next->text != NULL) ++next->text->refs;
+            BlockChanged(block);
+            BlockAdjust(rank, half - LINE_BLOCK_MAX);
+            BlockAdjust(rank + 1, LINE_BLOCK_MAX - half);
+            BlockResize(block);
+            BlockResize(next);
+
+            if (index >= half) {
+                block = next;
+                index -= half;
+                ++rank;
+            }
+        }
+    }
+
+    BlockChanged(block);
+    memmove(&block->line[index + 1], &block->line[index], (block->count - index) * sizeof(struct EditorLine));
+    BlockAdjust(rank, 1);
+    ++config.lines;
+    return &block->line[index];
+}
+
+// opens `count` uninitialized slots at the end, topping up the last block and building the
+// remaining full blocks into their own treap in one linear pass before merging it in
+void DocumentAppendLines(int count) {
+    struct LineBlock* last = config.lastBlock;
+    if (last != NULL && last->count < LINE_BLOCK_MAX) {
+        BlockThaw(last);
+        BlockChanged(last);
+        int fill = LINE_BLOCK_MAX - last->count;
+        if (fill > count) fill = count;
+        BlockAdjust(BlockCount(config.root) - 1, fill);
+        config.lines += fill;
+        count -= fill;
+    }
+    if (count == 0) return;
+
+    // blocks arrive in document order, so the treap is their cartesian tree on priority
+    int blocks = (count + LINE_BLOCK_MAX - 1) / LINE_BLOCK_MAX;
+    struct LineBlock** stack = (struct LineBlock**)malloc(blocks * sizeof(struct LineBlock*));
+    int depth = 0;
+    for (int i = 0; i < blocks; ++i) {
+        int lines = (count > LINE_BLOCK_MAX) ? LINE_BLOCK_MAX : count;
+        struct LineBlock* block = BlockNew(lines);
+        BlockHeat(block, 0);
+        BlockLink(block, config.lastBlock);
+        count -= lines;
+        config.lines += lines;
+
+        struct LineBlock* child = NULL;
+        while (depth > 0 && stack[depth - 1]->priority < block->priority) child = stack[--depth];
+        block->left = child;
+        if (depth > 0) stack[depth - 1]->right = block;
+        stack[depth++] = block;
+    }
+
+    BlockUpdateTree(stack[0]);
+    config.root = BlockMerge(config.root, stack[0]);
+    free(stack);
+}
+
+void DocumentAppendCold(struct ColdBlock* cold, int count, long long bytes) {
+    struct LineBlock* block = BlockNew(count);
+    block->bytes = bytes;
+    BlockUpdate(block);
+    block->cold = cold;
+    ++allocations;
+    BlockLink(block, config.lastBlock);
+    config.root = BlockMerge(config.root, block);
+    config.lines += count;
+}
+
+// bytes before line `at` in the text as a save writes it, a newline after every line
+long long DocumentOffset(int at) {
+    long long bytes = 0;
+    struct LineBlock* node = config.root;
+    while (node != NULL) {
+        int leftLines = BlockTotal(node->left);
+        if (at < leftLines) {
+            node = node->left;
+        }
+        else if (at < leftLines + node->count) {
+            bytes += BlockTotalBytes(node->left);
+            BlockThaw(node);
+            for (int i = 0; i < at - leftLines; ++i) bytes += node->line[i].str.len + 1;
+            return bytes;
+        }
+        else {
+            at -= leftLines + node->count;
+            bytes += BlockTotalBytes(node->left) + node->bytes;
+            node = node->right;
+        }
+    }
+    return bytes;
+}
+
+// the line holding byte `offset` and the offset it starts at, config.lines past the end
+int DocumentLineAt(long long offset, long long* start) {
+    int y = 0;
+    long long bytes = 0;
+    struct LineBlock* node = config.root;
+    while (node != NULL) {
+        long long leftBytes = BlockTotalBytes(node->left);
+        if (offset < leftBytes) {
+            node = node->left;
+        }
+        else if (offset < leftBytes + node->bytes) {
+            y += BlockTotal(node->left);
+            bytes += leftBytes;
+            offset -= leftBytes;
+            BlockThaw(node);
+            for (int i = 0; offset > node->line[i].str.len; ++i) {
+                offset -= node->line[i].str.len + 1;
+                bytes += node->line[i].str.len + 1;
+                ++y;
+            }
+            break;
+        }
+        else {
+            offset -= leftBytes + node->bytes;
+            bytes += leftBytes + node->bytes;
+            y += BlockTotal(node->left) + node->count;
+            node = node->right;
+        }
+    }
+    *start = bytes;
+    return y;
+}
+
+// removes the slot of line `at`, the caller is responsible for freeing its contents
+void DocumentDeleteLine(int at) {
+    int rank, index;
+    struct LineBlock* block = BlockLocate(at, &rank, &index);
+    if (block == NULL) return;
+
+    BlockThaw(block);
+    BlockChanged(block);
+    memmove(&block->line[index], &block->line[index + 1], (block->count - index - 1) * sizeof(struct EditorLine));
+    BlockAdjust(rank, -1);
+    BlockResize(block);
+    --config.lines;
+
+    if (block->count == 0) BlockRemove(block, rank);
+}
+
+struct EditorLine* LineIterInit(struct LineIter* it, int at) {
+    int rank;
+    it->block = BlockLocate(at, &rank, &it->index);
+    if (it->block == NULL) return NULL;
+    BlockThaw(it->block);
+    return &it->block->line[it->index];
+}
+
+struct EditorLine* LineIterNext(struct LineIter* it) {
+    if (it->block == NULL) return NULL;
+
+    if (++it->index >= it->block->count) {
+        it->block = it->block->next;
+        it->index = 0;
+        if (it->block == NULL) return NULL;
+        BlockThaw(it->block);
+    }
+    else if (it->block->line == NULL) {
+        // frozen by whatever the caller did since the last line
+        BlockThaw(it->block);
+    }
+    return &it->block->line[it->index];
+}
+
+struct EditorLine* LineIterPrev(struct LineIter* it) {
+    if (it->block == NULL) return NULL;
+
+    if (--it->index < 0) {
+        it->block = it->block->prev;
+        if (it->block == NULL) return NULL;
+        it->index = it->block->count - 1;
+        BlockThaw(it->block);
+    }
+    else if (it->block->line == NULL) {
+        BlockThaw(it->block);
+    }
+    return &it->block->line[it->index];
+}
+
+/*** line operations ***/
+
+// owned lines keep their text in a gap buffer: str.buf[0, gap) followed by the last
+// (len - gap) bytes of the allocation, so runs of edits at the cursor don't shift the line
+char* LineTail(struct EditorLine* line) {
+    return &line->str.buf[line->str.cap - (line->str.len - line->gap)];
+}
+
+char LineChar(struct EditorLine* line, int i) {
+    return (i < line->gap) ? line->str.buf[i] : LineTail(line)[i - line->gap];
+}
+
+void TabMoveGap(struct EditorLine* line, int at) {
+    struct TabIndex* tabs = line->tabs;
+    int len = line->str.len;
+    while (tabs->before > 0 && tabs->pos[tabs->before - 1] >= at) {
+        ++tabs->after;
+        tabs->pos[tabs->cap - tabs->after] = len - tabs->pos[--tabs->before];
+    }
+    while (tabs->after > 0 && len - tabs->pos[tabs->cap - tabs->after] < at) {
+        tabs->pos[tabs->before++] = len - tabs->pos[tabs->cap - tabs->after];
+        --tabs->after;
+    }
+}
+
+void LineMoveGap(struct EditorLine* line, int at) {
+    if (line->tabs) TabMoveGap(line, at);
+    if (at < line->gap) {
+        int len = line->gap - at;
+        memmove(LineTail(line) - len, &line->str.buf[at], len);
+    }
+    else if (at > line->gap) {
+        int len = at - line->gap;
+        memmove(&line->str.buf[line->gap], LineTail(line), len);
+    }
+    line->gap = at;
+}
+
+void LineReserve(struct EditorLine* line, int len) {
+    struct String* str = &line->str;
+    if (str->len + len <= str->cap) return;
+
+    int cap = (str->cap < 16) ? 16 : str->cap;
+    while (cap < str->len + len) cap *= 2;
+
+    int tailLen = str->len - line->gap;
+    char* buf = realloc(str->buf, cap);
+    ++allocations;
+    memmove(&buf[cap - tailLen], &buf[str->cap - tailLen], tailLen);
+    str->buf = buf;
+    str->cap = cap;
+}
+
+void TabReserve(struct EditorLine* line, int count) {
+    struct TabIndex* tabs = line->tabs;
+    if (tabs->before + tabs->after + count <= tabs->cap) return;
+
+    int cap = (tabs->cap < 8) ? 8 : tabs->cap;
+    while (cap < tabs->before + tabs->after + count) cap *= 2;
+
+    tabs = realloc(tabs, sizeof(struct TabIndex) + cap * sizeof(int));
+    ++allocations;
+    memmove(&tabs->pos[cap - tabs->after], &tabs->pos[tabs->cap - tabs->after], tabs->after * sizeof(int));
+    tabs->cap = cap;
+    line->tabs = tabs;
+}
+
+void TabInsert(struct EditorLine* line, int at) {
+    if (line->tabs == NULL) return;
+    TabReserve(line, 1);
+    line->tabs->pos[line->tabs->before++] = at;
+}
+
+void TabDelete(struct EditorLine* line, int at) {
+    struct TabIndex* tabs = line->tabs;
+    while (tabs && tabs->before > 0 && tabs->pos[tabs->before - 1] >= at) --tabs->before;
+}
+
+int TabCount(struct TabIndex* tabs) {
+    return tabs->before + tabs->after;
+}
+
+int TabAt(struct EditorLine* line, int i) {
+    struct TabIndex* tabs = line->tabs;
+    return (i < tabs->before) ? tabs->pos[i] : line->str.len - tabs->pos[tabs->cap - tabs->after + i - tabs->before];
+}
+
+struct TabIndex* LineTabs(struct EditorLine* line) {
+    if (line->tabs) return line->tabs;
+
+    char* head = line->str.buf;
+    char* tail = LineTail(line);
+    int tailLen = line->str.len - line->gap;
+    int count = 0;
+    for (char* tab = memchr(head, '\t', line->gap); tab != NULL; tab = memchr(tab + 1, '\t', &head[line->gap] - tab - 1)) ++count;
+    int before = count;
+    for (char* tab = memchr(tail, '\t', tailLen); tab != NULL; tab = memchr(tab + 1, '\t', &tail[tailLen] - tab - 1)) ++count;
+
+    struct TabIndex* tabs = malloc(sizeof(struct TabIndex) + count * sizeof(int));
+    ++allocations;
+    tabs->before = 0;
+    tabs->after = 0;
+    tabs->cap = count;
+    for (char* tab = memchr(head, '\t', line->gap); tab != NULL; tab = memchr(tab + 1, '\t', &head[line->gap] - tab - 1)) {
+        tabs->pos[tabs->before++] = tab - head;
+    }
+    for (char* tab = memchr(tail, '\t', tailLen); tab != NULL; tab = memchr(tab + 1, '\t', &tail[tailLen] - tab - 1)) {
+        tabs->pos[before + tabs->after++] = &tail[tailLen] - tab;
+    }
+    line->tabs = tabs;
+    return tabs;
+}
+
+// hands the tabs after the gap of `from` to `to`, a new line holding that part of the text,
+// so splitting a long line doesn't rescan what was moved
+void TabSplit(struct EditorLine* from, struct EditorLine* to) {
+    if (from->tabs == NULL) return;
+
+    int count = from->tabs->after;
+    int* end = &from->tabs->pos[from->tabs->cap - count];
+    to->tabs = malloc(sizeof(struct TabIndex) + count * sizeof(int));
+    ++allocations;
+    to->tabs->before = count;
+    to->tabs->after = 0;
+    to->tabs->cap = count;
+    for (int i = 0; i < count; ++i) to->tabs->pos[i] = to->str.len - end[i];
+}
+
+// cuts the line at `len` by dropping everything after the gap, it must not be a view
+void LineTruncate(struct EditorLine* line, int len) {
+    LineMoveGap(line, len);
+    StringTruncate(&line->str, len);
+    if (line->tabs) line->tabs->after = 0;
+}
+
+char* EditorLineText(struct EditorLine* line) {
+    if ((line->flags & LINE_VIEW) == 0) LineMoveGap(line, line->str.len);
+    return line->str.buf;
+}
+
+// every tab before x widens the line by EDITOR_TAB_LEN - 1, so only the count of those is needed
+int GetRenderOffset(struct EditorLine* line, int x) {
+    if ((line->flags & LINE_TABS) == 0) return x;
+
+    int low = 0;
+    int high = TabCount(LineTabs(line));
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (TabAt(line, mid) < x) low = mid + 1;
+        else high = mid;
+    }
+    return x + low * (EDITOR_TAB_LEN - 1);
+}
+
+int GetLineIndex(struct EditorLine* line, int renderOffset) {
+    int i = renderOffset;
+    if (line->flags & LINE_TABS) {
+        // tabs displayed entirely before the offset, tab k starts at column TabAt(k) + k * (EDITOR_TAB_LEN - 1)
+        int count = TabCount(LineTabs(line));
+        int low = 0;
+        int high = count;
+        while (low < high) {
+            int mid = low + (high - low) / 2;
+            if (TabAt(line, mid) + (mid + 1) * (int)(EDITOR_TAB_LEN - 1) + 1 <= renderOffset) low = mid + 1;
+            else high = mid;
+        }
+        if (low < count && TabAt(line, low) + low * (int)(EDITOR_TAB_LEN - 1) <= renderOffset) i = TabAt(line, low);
+        else i = renderOffset - low * (EDITOR_TAB_LEN - 1);
+    }
+    return (i < line->str.len) ? i : line->str.len - 1;
+}
+
+void EditorUpdateLine(struct EditorLine* line) {
+    int tabs = 0;
+    const char* tail = LineTail(line);
+    for (int i = 0; i < line->str.len; ++i) {
+        if (LineChar(line, i) == '\t') ++tabs;
+    }
+
+    line->flags |= LINE_RENDERED;
+    if (tabs == 0) {
+        line->flags &= ~LINE_TABS;
+        StringFree(&line->render);
+        return;
+    }
+
+    StringTruncate(&line->render, 0);
+    StringReserve(&line->render, line->str.len + tabs * (EDITOR_TAB_LEN - 1));
+    for (int i = 0; i < line->str.len; ++i) {
+        char c = (i < line->gap) ? line->str.buf[i] : tail[i - line->gap];
+        if (c == '\t') {
+            memcpy(&line->render.buf[line->render.len], EDITOR_TAB, EDITOR_TAB_LEN);
+            line->render.len += EDITOR_TAB_LEN;
+        }
+        else {
+            line->render.buf[line->render.len++] = c;
+        }
+    }
+    // char status[64];
+    // int len = snprintf(status, sizeof(status), "[len: %d | upt: %ld]", line->str.len, GET_TIME);
+    // StringAppend(&line->render, status, len); 
+}
+
+void EditorLineChanged(struct EditorLine* line) {
+    line->flags &= ~(LINE_RENDERED | LINE_LEXED);
+    SearchInvalidate();
+
+    struct LineBlock* block = BlockOfLine(line);
+    if (block != NULL) BlockResize(block);
+}
+
+char* EditorLineRender(struct EditorLine* line, int* len) {
+    if ((line->flags & LINE_TABS) && (line->flags & LINE_RENDERED) == 0) {
+        EditorUpdateLine(line);
+    }
+    if (line->flags & LINE_TABS) {
+        *len = line->render.len;
+        return line->render.buf;
+    }
+    *len = line->str.len;
+    return EditorLineText(line);
+}
+
+// expands only the tabs inside displayed columns [from, from + len), finding the first through the tab index
+void LineAppendWindow(struct String* term, struct EditorLine* line, int from, int len) {
+    if (from >= GetRenderOffset(line, line->str.len)) return;
+
+    int i = GetLineIndex(line, from);
+    int skip = from - GetRenderOffset(line, i);
+    for (; len > 0 && i < line->str.len; ++i) {
+        char c = LineChar(line, i);
+        if (c == '\t') {
+            int n = EDITOR_TAB_LEN - skip;
+            if (n > len) n = len;
+            StringAppend(term, EDITOR_TAB, n);
+            len -= n;
+        }
+        else {
+            StringAppend(term, &c, 1);
+            --len;
+        }
+        skip = 0;
+    }
+}
+
+void EditorLineAppendRender(struct String* term, struct EditorLine* line, int from, int len) {
+    if ((line->flags & LINE_TABS) && line->str.len > LINE_WINDOW) {
+        // a render of the whole line would be rebuilt on every edit, for a few screenfuls of text
+        StringFree(&line->render);
+        LineAppendWindow(term, line, from, len);
+        return;
+    }
+    if (line->flags & LINE_TABS) {
+        int renderLen;
+        char* render = EditorLineRender(line, &renderLen);
+        if (from + len > renderLen) len = renderLen - from;
+        if (len > 0) StringAppend(term, &render[from], len);
+        return;
+    }
+
+    if (from + len > line->str.len) len = line->str.len - from;
+    if (len <= 0) return;
+    if (from < line->gap) {
+        int head = (from + len <= line->gap) ? len : line->gap - from;
+        StringAppend(term, &line->str.buf[from], head);
+        from += head;
+        len -= head;
+    }
+    StringAppend(term, &LineTail(line)[from - line->gap], len);
+}
+
+struct EditorLine* EditorNewLine(int at) {
+    SearchInvalidate();
+    HighlightInvalidate(at);
+    HighlightShift(at, 1);
+    struct EditorLine* line = DocumentInsertLine(at);
+    line->render.buf = NULL;
+    line->render.len = 0;
+    line->render.cap = 0;
+    line->tabs = NULL;
+    line->hl = NULL;
+    line->flags = 0;
+    line->hlStart = LEX_NORMAL;
+    line->hlEnd = LEX_NORMAL;
+    return line;
+}
+
+void EditorInsertLine(char* buf, int len, int at) {
+    if (at < 0 || at > config.lines) return;
+
+    struct EditorLine* line = EditorNewLine(at);
+
+    line->str.buf = (char*)malloc(len);
+    ++allocations;
+    if (len > 0) memcpy(line->str.buf, buf, len);
+    line->str.len = len;
+    line->str.cap = len;
+    line->gap = len;
+    if (len > 0 && memchr(buf, '\t', len) != NULL) line->flags |= LINE_TABS;
+    BlockResize(BlockOfLine(line));
+
+    ++config.dirty;
+}
+
+// makes the line view loaded text, it is copied to its own allocation on its first edit
+void EditorInitViewLine(struct EditorLine* line, char* buf, int len) {
+    line->render.buf = NULL;
+    line->render.len = 0;
+    line->render.cap = 0;
+    line->tabs = NULL;
+    line->hl = NULL;
+    line->str.buf = buf;
+    line->str.len = len;
+    line->str.cap = 0;
+    line->gap = len;
+    line->flags = LINE_VIEW;
+    line->hlStart = LEX_NORMAL;
+    line->hlEnd = LEX_NORMAL;
+    if (memchr(buf, '\t', len) != NULL) line->flags |= LINE_TABS;
+}
+
+void EditorLineOwn(struct EditorLine* line) {
+    if ((line->flags & LINE_VIEW) == 0) return;
+
+    char* buf = (char*)malloc(line->str.len);
+    ++allocations;
+    memcpy(buf, line->str.buf, line->str.len);
+    line->str.buf = buf;
+    line->str.cap = line->str.len;
+    line->gap = line->str.len;
+    line->flags &= ~LINE_VIEW;
+}
+
+void EditorFreeLine(struct EditorLine* line) {
+    if ((line->flags & LINE_VIEW) == 0) StringFree(&line->str);
+    StringFree(&line->render);
+    free(line->tabs);
+    free(line->hl);
+}
+
+void EditorDeleteLine(int at) {
+    if (at < 0 || at >= config.lines) return;
+    
+    EditorFreeLine(DocumentLine(at));
+    DocumentDeleteLine(at);
+    SearchInvalidate();
+    HighlightShift(at, -1);
+    HighlightInvalidate(at);
+    
+    ++config.dirty;
+}
+
+// drops every line, for when the file is replaced underneath the document
+void EditorClear(void) {
+    struct LineBlock* block = config.firstBlock;
+    while (block != NULL) {
+        for (int i = 0; block->line != NULL && i < block->count; ++i) EditorFreeLine(&block->line[i]);
+        struct LineBlock* next = block->next;
+        BlockFree(block);
+        block = next;
+    }
+    config.root = NULL;
+    config.firstBlock = NULL;
+    config.lastBlock = NULL;
+    config.lines = 0;
+    SearchInvalidate();
+    HighlightInvalidate(0);
+    config.hlKnown = 0;
+}
+
+void EditorLineInsertChar(struct EditorLine* line, int at, char c) {
+    EditorLineOwn(line);
+    struct String* str = &line->str;
+    if (at < 0 || at > str->len) at = str->len;
+
+    LineReserve(line, 1);
+    LineMoveGap(line, at);
+    str->buf[line->gap] = c;
+    if (c == '\t') {
+        line->flags |= LINE_TABS;
+        TabInsert(line, at);
+    }
+    ++line->gap;
+    ++str->len;
+
+    EditorLineChanged(line);
+    ++config.dirty;
+}
+
+void EditorLineAppendString(struct EditorLine* line, const char* buf, int len) {
+    EditorLineOwn(line);
+    LineReserve(line, len);
+    LineMoveGap(line, line->str.len);
+    memcpy(&line->str.buf[line->gap], buf, len);
+    for (const char* tab = memchr(buf, '\t', len); tab != NULL; tab = memchr(tab + 1, '\t', &buf[len] - tab - 1)) {
+        line->flags |= LINE_TABS;
+        TabInsert(line, line->gap + (tab - buf));
+    }
+    line->gap += len;
+    line->str.len += len;
+    EditorLineChanged(line);
+}
+
+void EditorLineDeleteRange(struct EditorLine* line, int at, int len) {
+    struct String* str = &line->str;
+    if (at < 0 || len <= 0 || at + len > str->len) return;
+    EditorLineOwn(line);
+
+    LineMoveGap(line, at + len);
+    TabDelete(line, at);
+    line->gap -= len;
+    str->len -= len;
+
+    EditorLineChanged(line);
+    ++config.dirty;
+}
+
+void EditorLineDeleteChar(struct EditorLine* line, int at) {
+    EditorLineDeleteRange(line, at, 1);
+}
+
+/*** cold blocks ***/
+
+// blocks nothing touched for a while give up their lines: a run of the mapped file goes back to
+// being a range of it and any other text is compressed, so a file far larger than memory fits;
+// the lines come back as views the first time the block is drawn, searched or edited
+
+// `states` slots are left at the start of data for the caller; takes no count of the allocation,
+// so the loader thread can pack blocks too
+struct ColdBlock* ColdCompress(const char* text, int len, int states, int raw) {
+    struct ColdBlock* cold = (struct ColdBlock*)malloc(sizeof(struct ColdBlock) + states + LZ_BOUND(len));
+    cold->offset = 0;
+    cold->len = len;
+    cold->packed = LzPack(text, len, &cold->data[states]);
+    cold->raw = raw;
+    cold->states = states;
+    return (struct ColdBlock*)realloc(cold, sizeof(struct ColdBlock) + states + cold->packed);
+}
+
+// finds the range of the mapping spanned by the lines, if they are still views of consecutive
+// lines of it, separated the way the file separates them
+int ColdMapRange(struct LineBlock* block, size_t* offset, int* len) {
+    if (config.map == NULL) return 0;
+
+    char* end = &config.map[config.mapLen];
+    for (int i = 0; i < block->count; ++i) {
+        struct EditorLine* line = &block->line[i];
+        char* buf = line->str.buf;
+        if ((line->flags & LINE_VIEW) == 0 || buf < config.map || buf + line->str.len > end) return 0;
+        if (i + 1 == block->count) break;
+
+        char* sep = buf + line->str.len;
+        char* next = block->line[i + 1].str.buf;
+        while (sep < next && *sep == '\r') ++sep;
+        if (sep + 1 != next || *sep != '\n') return 0;
+    }
+
+    struct EditorLine* last = &block->line[block->count - 1];
+    size_t bytes = last->str.buf + last->str.len - block->line[0].str.buf;
+    if (bytes > COLD_MAX_TEXT) return 0;
+    *offset = block->line[0].str.buf - config.map;
+    *len = (int)bytes;
+    return 1;
+}
+
+struct ColdBlock* ColdPack(struct LineBlock* block, int states) {
+    size_t offset;
+    int len;
+    if (ColdMapRange(block, &offset, &len)) {
+        struct ColdBlock* cold = (struct ColdBlock*)malloc(sizeof(struct ColdBlock) + states);
+        ++allocations;
+        cold->offset = offset;
+        cold->len = len;
+        cold->packed = 0;
+        cold->raw = 1;
+        cold->states = states;
+        return cold;
+    }
+
+    size_t bytes = block->count - 1;
+    for (int i = 0; i < block->count; ++i) bytes += block->line[i].str.len;
+    if (bytes > COLD_MAX_TEXT) return NULL;
+
+    char* text = (char*)malloc(bytes + 1);
+    ++allocations;
+    char* at = text;
+    for (int i = 0; i < block->count; ++i) {
+        struct EditorLine* line = &block->line[i];
+        if (i > 0) *at++ = '\n';
+        if (line->str.len == 0) continue;
+        memcpy(at, line->str.buf, line->gap);
+        memcpy(&at[line->gap], LineTail(line), line->str.len - line->gap);
+        at += line->str.len;
+    }
+    struct ColdBlock* cold = ColdCompress(text, (int)bytes, states, 0);
+    ++allocations;
+    free(text);
+    return cold;
+}
+
+// a thawed block whose lines are all still views holds the text its compressed copy was made of
+int BlockClean(struct LineBlock* block) {
+    for (int i = 0; i < block->count; ++i) {
+        if ((block->line[i].flags & LINE_VIEW) == 0) return 0;
+    }
+    return 1;
+}
+
+int BlockFreeze(struct LineBlock* block) {
+    int count = block->count;
+    int states = (config.syntax != NULL) ? count + 1 : 0;
+    struct ColdBlock* cold = block->cold;
+    if (cold == NULL || cold->states != states || !BlockClean(block)) {
+        cold = ColdPack(block, states);
+        if (cold == NULL) return 0;
+        free(block->cold);
+        block->cold = cold;
+    }
+
+    // the states the lines were lexed from, so thawed lines are lexed again without the ones above
+    if (states > 0) {
+        for (int i = 0; i < count; ++i) cold->data[i] = block->line[i].hlStart;
+        cold->data[count] = block->line[count - 1].hlEnd;
+    }
+
+    for (int i = 0; i < count; ++i) EditorFreeLine(&block->line[i]);
+    HotUnlink(block);
+    free(block->line);
+    block->line = NULL;
+    ThawRelease(block->text);
+    block->text = NULL;
+    return 1;
+}
+
+void ColdEvict(void) {
+    for (int excess = config.hot.count - COLD_HOT_BLOCKS; excess > 0; --excess) {
+        struct LineBlock* block = config.hot.last;
+        if (!BlockFreeze(block)) HotTouch(block);
+    }
+}
+
+char* ColdText(struct ColdBlock* cold, char* buf) {
+    if (cold->packed == 0) return &config.map[cold->offset];
+    LzUnpack(&cold->data[cold->states], cold->packed, buf, cold->len);
+    return buf;
+}
+
+char* ColdNextLine(struct ColdBlock* cold, char* text, char* end, int* len) {
+    char* nl = memchr(text, '\n', end - text);
+    if (nl == NULL) nl = end;
+    int n = nl - text;
+    if (cold->raw) {
+        while (n > 0 && text[n - 1] == '\r') --n;
+    }
+    *len = n;
+    return nl;
+}
+
+void BlockThaw(struct LineBlock* block) {
+    if (block->line != NULL) {
+        HotTouch(block);
+        return;
+    }
+
+    struct ColdBlock* cold = block->cold;
+    if (cold->packed > 0) {
+        block->text = (struct ThawText*)malloc(sizeof(struct ThawText) + cold->len);
+        ++allocations;
+        block->text->refs = 1;
+    }
+    char* text = ColdText(cold, (block->text == NULL) ? NULL : block->text->data);
+    char* end = &text[cold->len];
+
+    BlockHeat(block, 1);
+    for (int i = 0; i < block->count; ++i) {
+        int len;
+        char* nl = ColdNextLine(cold, text, end, &len);
+        struct EditorLine* line = &block->line[i];
+        EditorInitViewLine(line, text, len);
+        if (cold->states > 0) {
+            line->hlStart = cold->data[i];
+            line->hlEnd = cold->data[i + 1];
+        }
+        text = nl + 1;
+    }
+    ColdEvict();
+}
+
+/*** syntax highlighting ***/
+
+int IsSeparator(int c) {
+    return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];{}&|!?:^", c) != NULL;
+}
+
+void EditorSelectSyntax(void) {
+    config.syntax = NULL;
+    config.hlValid = 0;
+    config.hlKnown = 0;
+    if (config.fileName == NULL) return;
+
+    const char* ext = strrchr(config.fileName, '.');
+    if (ext == NULL) return;
+    for (unsigned i = 0; i < sizeof(syntaxes) / sizeof(syntaxes[0]); ++i) {
+        for (const char** match = syntaxes[i].extensions; *match != NULL; ++match) {
+            if (strcmp(ext, *match) == 0) {
+                config.syntax = &syntaxes[i];
+                return;
+            }
+        }
+    }
+}
+
+// the lines below an edit keep the states they were lexed from, so the watermark can jump back to
+// where it was once the state carried past the edits agrees with one of them again
+void HighlightInvalidate(int y) {
+    if (y >= config.hlValid) {
+        if (y < config.hlKnown && y >= config.hlDirty) config.hlDirty = y + 1;
+        return;
+    }
+    if (config.hlKnown <= config.hlValid) {
+        config.hlKnown = config.hlValid;
+        config.hlDirty = y + 1;
+    }
+    else if (config.hlDirty <= y) {
+        config.hlDirty = y + 1;
+    }
+    config.hlValid = y;
+}
+
+void HighlightShift(int at, int delta) {
+    if (at < config.hlKnown) config.hlKnown += delta;
+    if (at < config.hlDirty) config.hlDirty += delta;
+}
+
+void HighlightLine(struct EditorLine* line, unsigned char state) {
+    line->flags |= LINE_LEXED;
+    line->hlStart = state;
+    line->hlEnd = state;
+
+    // too long to lex on every edit, shown plain and taken to leave the state as it found it
+    int len = line->str.len;
+    if (len > LINE_WINDOW) {
+        free(line->hl);
+        line->hl = NULL;
+        return;
+    }
+
+    const char* text = EditorLineText(line);
+    unsigned char* hl = realloc(line->hl, len + 1);
+    ++allocations;
+    line->hl = hl;
+    memset(hl, ATTR_DEFAULT, len);
+
+    int inComment = state == LEX_COMMENT;
+    char quote = 0;
+    int prevSep = 1;
+    int i = 0;
+    if (!inComment) {
+        while (i < len && isspace((unsigned char)text[i])) ++i;
+        if (i < len && text[i] == '#') {
+            int end = i + 1;
+            while (end < len && isalpha((unsigned char)text[end])) ++end;
+            memset(&hl[i], ATTR_PREPROC, end - i);
+            i = end;
+        }
+    }
+
+    while (i < len) {
+        char c = text[i];
+        if (inComment) {
+            hl[i] = ATTR_COMMENT;
+            if (c == '*' && i + 1 < len && text[i + 1] == '/') {
+                hl[++i] = ATTR_COMMENT;
+                inComment = 0;
+                prevSep = 1;
+            }
+            ++i;
+            continue;
+        }
+        if (quote) {
+            hl[i] = ATTR_STRING;
+            if (c == '\\' && i + 1 < len) {
+                hl[++i] = ATTR_STRING;
+            }
+            else if (c == quote) {
+                quote = 0;
+                prevSep = 1;
+            }
+            ++i;
+            continue;
+        }
+        if (c == '/' && i + 1 < len && text[i + 1] == '/') {
+            memset(&hl[i], ATTR_COMMENT, len - i);
+            break;
+        }
+        if (c == '/' && i + 1 < len && text[i + 1] == '*') {
+            hl[i] = ATTR_COMMENT;
+            hl[i + 1] = ATTR_COMMENT;
+            inComment = 1;
+            i += 2;
+            continue;
+        }
+        if (c == '"' || c == '\'') {
+            hl[i++] = ATTR_STRING;
+            quote = c;
+            continue;
+        }
+        if ((isdigit((unsigned char)c) && prevSep) || (i > 0 && hl[i - 1] == ATTR_NUMBER && (isalnum((unsigned char)c) || c == '.'))) {
+            hl[i++] = ATTR_NUMBER;
+            prevSep = 0;
+            continue;
+        }
+        if (prevSep) {
+            const char** keyword = config.syntax->keywords;
+            for (; *keyword != NULL; ++keyword) {
+                if ((*keyword)[0] != c) continue;
+                int klen = strlen(*keyword);
+                int type = (*keyword)[klen - 1] == '|';
+                if (type) --klen;
+                if (i + klen <= len && memcmp(&text[i], *keyword, klen) == 0 && (i + klen == len || IsSeparator(text[i + klen]))) {
+                    memset(&hl[i], type ? ATTR_TYPE : ATTR_KEYWORD, klen);
+                    i += klen;
+                    break;
+                }
+            }
+            if (*keyword != NULL) {
+                prevSep = 0;
+                continue;
+            }
+        }
+        prevSep = IsSeparator((unsigned char)c);
+        ++i;
+    }
+    line->hlEnd = inComment ? LEX_COMMENT : LEX_NORMAL;
+}
+
+// highlights lines [from, to), lexing only those whose start state differs from what they were lexed
+// with; `exact` walks on from the watermark, otherwise `from` is assumed to start outside any comment
+void HighlightRun(int from, int to, int exact) {
+    unsigned char state = LEX_NORMAL;
+    if (exact && from > 0) state = DocumentLine(from - 1)->hlEnd;
+    // the guessed states overwrite ones that were exact
+    if (!exact && to > config.hlDirty) config.hlDirty = to;
+
+    struct LineIter it;
+    int y = from;
+    struct EditorLine* line = LineIterInit(&it, y);
+    while (y < to && line != NULL) {
+        if (exact && y >= config.hlDirty && y < config.hlKnown && line->hlStart == state) {
+            y = config.hlKnown;
+            config.hlKnown = 0;
+            if (y >= to) break;
+            state = DocumentLine(y - 1)->hlEnd;
+            line = LineIterInit(&it, y);
+            continue;
+        }
+        if ((line->flags & LINE_LEXED) == 0 || line->hlStart != state) HighlightLine(line, state);
+        state = line->hlEnd;
+        line = LineIterNext(&it);
+        ++y;
+    }
+    if (exact) config.hlValid = (y > to) ? y : to;
+}
+
+// highlights everything down to line `to`; when the watermark is far above, a jump deep into the file
+// lexes only HL_SYNC_LINES above the screen and the exact states are caught up while idle
+void HighlightUpdate(int to) {
+    if (config.syntax == NULL) return;
+    if (to > config.lines) to = config.lines;
+
+    int from = to - config.rows - HL_SYNC_LINES;
+    if (to > config.hlValid && from <= config.hlValid) HighlightRun(config.hlValid, to, 1);
+    // below the edits the states from before them are as good a guess as any
+    else if (to > config.hlValid && (from < config.hlDirty || to > config.hlKnown)) HighlightRun(from, to, 0);
+
+    // lines thawed or skipped over kept the state they start in but not their attributes
+    struct LineIter it;
+    struct EditorLine* line = LineIterInit(&it, config.rowOffset);
+    for (int y = config.rowOffset; y < to && line != NULL; ++y, line = LineIterNext(&it)) {
+        if ((line->flags & LINE_LEXED) == 0) HighlightLine(line, line->hlStart);
+    }
+}
+
+int HighlightPending(void) {
+    return config.syntax != NULL && config.hlValid < config.lines;
+}
+
+// moves the watermark on by a step, returns 1 when it just passed the screen so it can be redrawn exactly
+int HighlightIdle(void) {
+    int bottom = config.rowOffset + config.rows;
+    int from = config.hlValid;
+    int to = (config.lines - from > HL_IDLE_LINES) ? from + HL_IDLE_LINES : config.lines;
+    HighlightRun(from, to, 1);
+    return from < bottom && to >= bottom;
+}
+
+void EditorLineAppendHighlight(struct String* attrs, struct EditorLine* line, int from, int len) {
+    if ((line->flags & LINE_TABS) == 0) {
+        StringAppend(attrs, (char*)&line->hl[from], len);
+        return;
+    }
+
+    int i = GetLineIndex(line, from);
+    int skip = from - GetRenderOffset(line, i);
+    for (; len > 0 && i < line->str.len; ++i) {
+        int n = (LineChar(line, i) == '\t') ? (int)EDITOR_TAB_LEN - skip : 1;
+        if (n > len) n = len;
+        for (int k = 0; k < n; ++k) StringAppend(attrs, (char*)&line->hl[i], 1);
+        len -= n;
+        skip = 0;
+    }
+}
+
+/*** undo ***/
+
+long long UndoSeq(struct UndoLog* log) {
+    if (log->last) return log->last->seq;
+    return (log->first) ? log->first->base : log->seq;
+}
+
+int UndoSize(int len) {
+    return (sizeof(struct UndoRecord) + len + 7) & ~7;
+}
+
+// undone records are the newest allocations, so a new edit pops them off the arena
+void UndoDiscardRedo(struct UndoLog* log) {
+    struct UndoRecord* next = (log->last) ? log->last->next : log->first;
+    if (next == NULL) return;
+
+    while (log->slabs != next->slab) {
+        struct ArenaSlab* slab = log->slabs;
+        log->slabs = slab->next;
+        log->bytes -= slab->size;
+        free(slab);
+    }
+    log->slabs->used = (char*)next - log->slabs->data;
+    if (log->slabs->used == 0) {
+        struct ArenaSlab* slab = log->slabs;
+        log->slabs = slab->next;
+        log->bytes -= slab->size;
+        free(slab);
+    }
+    if (log->last) log->last->next = NULL;
+    else log->first = NULL;
+}
+
+void UndoClear(struct UndoLog* log) {
+    long long seq = UndoSeq(log);
+    ArenaFree(&log->slabs);
+    log->bytes = 0;
+    log->first = NULL;
+    log->last = NULL;
+    log->open = NULL;
+    log->seq = seq;
+    log->savedSeq = seq;
+}
+
+// frees whole slabs of the oldest records until the log fits its budget, the newest slab always stays
+void UndoEvict(struct UndoLog* log) {
+    while (log->bytes > log->budget && log->slabs->next != NULL) {
+        struct ArenaSlab* keep = log->slabs;
+        while (keep->next->next != NULL) keep = keep->next;
+
+        log->bytes -= keep->next->size;
+        free(keep->next);
+        keep->next = NULL;
+
+        // records never straddle slabs, so the oldest one left starts the slab
+        log->first = (struct UndoRecord*)keep->data;
+        log->first->prev = NULL;
+    }
+}
+
+struct UndoRecord* UndoAppend(int kind, int y, int x, const char* text, int len, int newLine) {
+    struct UndoLog* log = &config.undo;
+    long long base = UndoSeq(log);
+    UndoDiscardRedo(log);
+
+    size_t size = UndoSize(len);
+    struct ArenaSlab* slab = log->slabs;
+    if (slab == NULL || slab->used + size > slab->size) {
+        slab = ArenaSlabNew(&log->slabs, (size > ARENA_SLAB) ? size : ARENA_SLAB);
+        log->bytes += slab->size;
+    }
+    struct UndoRecord* rec = (struct UndoRecord*)&slab->data[slab->used];
+    slab->used += size;
+
+    rec->prev = log->last;
+    rec->next = NULL;
+    rec->slab = slab;
+    rec->base = base;
+    rec->seq = ++log->seq;
+    rec->kind = kind;
+    rec->newLine = newLine;
+    rec->y = y;
+    rec->x = x;
+    rec->len = len;
+    if (len > 0) memcpy(rec->text, text, len);
+
+    if (log->last) log->last->next = rec;
+    else log->first = rec;
+    log->last = rec;
+    log->open = rec;
+
+    UndoEvict(log);
+    return rec;
+}
+
+// grows the open record by a byte in place, only possible while it is the top of its slab
+int UndoExtend(struct UndoRecord* rec, char c) {
+    struct ArenaSlab* slab = rec->slab;
+    size_t end = (char*)rec - slab->data + UndoSize(rec->len + 1);
+    if (end > slab->size) return 0;
+
+    rec->text[rec->len++] = c;
+    if (end > slab->used) slab->used = end;
+    return 1;
+}
+
+// typing on one line coalesces into a single record, line breaks get their own
+void UndoInsertChar(int y, int x, char c, int newLine) {
+    struct UndoLog* log = &config.undo;
+    if (log->replaying) return;
+    JournalRecord(UNDO_INSERT, newLine, y, x, &c, 1);
+
+    struct UndoRecord* rec = log->open;
+    if (c != '\n' && rec && rec == log->last && rec->kind == UNDO_INSERT && rec->y == y && rec->x + rec->len == x
+            && UndoExtend(rec, c)) {
+        return;
+    }
+    UndoAppend(UNDO_INSERT, y, x, &c, 1, newLine);
+    if (c == '\n') log->open = NULL;
+}
+
+// a run of backspaces on one line coalesces into a single record growing towards the start of the line
+void UndoDeleteChar(int y, int x, char c) {
+    struct UndoLog* log = &config.undo;
+    if (log->replaying) return;
+    JournalRecord(UNDO_DELETE, 0, y, x, &c, 1);
+
+    struct UndoRecord* rec = log->open;
+    if (c != '\n' && rec && rec == log->last && rec->kind == UNDO_DELETE && rec->y == y && rec->x == x + 1
+            && UndoExtend(rec, c)) {
+        rec->x = x;
+        return;
+    }
+    UndoAppend(UNDO_DELETE, y, x, &c, 1, 0);
+    if (c == '\n') log->open = NULL;
+}
+
+void UndoInsertText(int y, int x, const char* text, int len, int newLine) {
+    if (config.undo.replaying) return;
+    JournalRecord(UNDO_INSERT, newLine, y, x, text, len);
+    UndoAppend(UNDO_INSERT, y, x, text, len, newLine);
+    config.undo.open = NULL;
+}
+
+/*** editor operations ***/
+
+void EditorInsertChar(int c) {
+    HighlightInvalidate(config.y);
+    int newLine = config.y == config.lines;
+    if (newLine) {
+        EditorInsertLine(NULL, 0, config.lines);
+    }
+    UndoInsertChar(config.y, config.x, (char)c, newLine);
+    EditorLineInsertChar(DocumentLine(config.y), config.x, (char)c);
+    ++config.x;
+}
+
+void EditorInsertNewLine(void) {
+    HighlightInvalidate(config.y);
+    // Enter past the last line only appends one, so no text is recorded for it
+    if (config.y == config.lines) UndoInsertText(config.y, config.x, NULL, 0, 1);
+    else UndoInsertChar(config.y, config.x, '\n', 0);
+    if (config.x == 0) {
+        EditorInsertLine(NULL, 0, config.y);
+    }
+    else {
+        struct EditorLine* line = DocumentLine(config.y);
+        EditorLineOwn(line);
+        LineMoveGap(line, config.x);
+        EditorInsertLine(LineTail(line), line->str.len - config.x, config.y + 1);
+
+        line = DocumentLine(config.y);
+        TabSplit(line, DocumentLine(config.y + 1));
+        LineTruncate(line, config.x);
+
+        EditorLineChanged(line);
+    }
+    ++config.y;
+    config.x = 0;
+}
+
+void EditorInsertText(char* buf, int len) {
+    if (len == 0) return;
+    HighlightInvalidate(config.y);
+    int newLine = config.y == config.lines;
+    if (newLine) {
+        EditorInsertLine(NULL, 0, config.lines);
+    }
+    UndoInsertText(config.y, config.x, buf, len, newLine);
+
+    struct EditorLine* line = DocumentLine(config.y);
+    int tailLen = line->str.len - config.x;
+    char* tail = malloc(tailLen + 1);
+    ++allocations;
+    EditorLineOwn(line);
+    LineMoveGap(line, config.x);
+    memcpy(tail, LineTail(line), tailLen);
+    LineTruncate(line, config.x);
+
+    int start = 0;
+    for (int i = 0; i <= len; ++i) {
+        if (i < len && buf[i] != '\n') continue;
+
+        if (start == 0) {
+            EditorLineAppendString(line, buf, i);
+            config.x += i;
+        }
+        else {
+            EditorInsertLine(&buf[start], i - start, ++config.y);
+            config.x = i - start;
+        }
+        start = i + 1;
+    }
+
+    line = DocumentLine(config.y);
+    EditorLineAppendString(line, tail, tailLen);
+    free(tail);
+    ++config.dirty;
+}
+
+void EditorDeleteChar(void) {
+    if (config.y == config.lines) return;
+    if (config.x == 0 && config.y == 0) return;
+    HighlightInvalidate((config.x > 0) ? config.y : config.y - 1);
+
+    struct EditorLine* line = DocumentLine(config.y);
+    if (config.x > 0) {
+        UndoDeleteChar(config.y, config.x - 1, LineChar(line, config.x - 1));
+        EditorLineDeleteChar(line, config.x - 1);
+        --config.x;
+    }
+    else {
+        struct EditorLine* prev = DocumentLine(config.y - 1);
+        config.x = prev->str.len;
+        UndoDeleteChar(config.y - 1, config.x, '\n');
+        EditorLineAppendString(prev, line->str.buf, line->gap);
+        EditorLineAppendString(prev, LineTail(line), line->str.len - line->gap);
+        EditorDeleteLine(config.y);
+        --config.y;
+    }
+}
+
+// removes `len` bytes of text starting at y, x, where every \n in `text` stands for a line break
+void EditorDeleteText(int y, int x, const char* text, int len) {
+    HighlightInvalidate(y);
+    int breaks = 0;
+    int lastLen = len;
+    for (const char* nl = memchr(text, '\n', len); nl != NULL; nl = memchr(nl + 1, '\n', &text[len] - nl - 1)) {
+        ++breaks;
+        lastLen = &text[len] - nl - 1;
+    }
+    struct EditorLine* line = DocumentLine(y);
+    if (breaks == 0) {
+        EditorLineDeleteRange(line, x, len);
+        return;
+    }
+
+    struct EditorLine* last = DocumentLine(y + breaks);
+    EditorLineOwn(last);
+    LineMoveGap(last, lastLen);
+    int tailLen = last->str.len - lastLen;
+    char* tail = malloc(tailLen + 1);
+    ++allocations;
+    memcpy(tail, LineTail(last), tailLen);
+
+    for (int i = 0; i < breaks; ++i) EditorDeleteLine(y + 1);
+    line = DocumentLine(y);
+    EditorLineOwn(line);
+    LineTruncate(line, x);
+    EditorLineAppendString(line, tail, tailLen);
+    free(tail);
+}
+
+// inserts or removes text at y, x without adding to the undo log, for undo, redo and journal replay
+void EditorApplyEdit(int kind, int newLine, int y, int x, char* text, int len) {
+    JournalRecord(kind, newLine, y, x, text, len);
+    config.undo.replaying = 1;
+    config.y = y;
+    config.x = x;
+
+    if (kind == UNDO_DELETE) {
+        EditorDeleteText(y, x, text, len);
+        if (newLine) EditorDeleteLine(y);
+    }
+    else {
+        if (newLine) EditorInsertLine(NULL, 0, config.lines);
+        EditorInsertText(text, len);
+        // Enter on the line past the last one appended a line without inserting any text
+        if (newLine && len == 0) ++config.y;
+    }
+    config.undo.replaying = 0;
+}
+
+void EditorUndoApply(struct UndoRecord* rec, int undo) {
+    // the removed text of a backspace run was recorded back to front
+    char* text = rec->text;
+    if (rec->kind == UNDO_DELETE) {
+        text = malloc(rec->len + 1);
+        ++allocations;
+        for (int i = 0; i < rec->len; ++i) text[i] = rec->text[rec->len - 1 - i];
+    }
+
+    int kind = ((rec->kind == UNDO_INSERT) == undo) ? UNDO_DELETE : UNDO_INSERT;
+    EditorApplyEdit(kind, rec->newLine, rec->y, rec->x, text, rec->len);
+
+    if (text != rec->text) free(text);
+}
+
+void EditorUndoDone(struct UndoLog* log) {
+    log->open = NULL;
+    if (UndoSeq(log) == log->savedSeq) config.dirty = 0;
+    else ++config.dirty;
+}
+
+void EditorUndo(void) {
+    struct UndoLog* log = &config.undo;
+    if (log->last == NULL) {
+        EditorSetMessage("Nothing to undo");
+        return;
+    }
+    EditorUndoApply(log->last, 1);
+    log->last = log->last->prev;
+    EditorUndoDone(log);
+}
+
+void EditorRedo(void) {
+    struct UndoLog* log = &config.undo;
+    struct UndoRecord* next = (log->last) ? log->last->next : log->first;
+    if (next == NULL) {
+        EditorSetMessage("Nothing to redo");
+        return;
+    }
+    EditorUndoApply(next, 0);
+    log->last = next;
+    EditorUndoDone(log);
+}
+
+/*** scan ***/
+
+struct LineScan {
+    pthread_t thread;
+    int started;
+    char* buf;
+    size_t from, to;
+    size_t* nl;
+    int count;
+    int cap;
+    int line;
+    size_t start;
+    int lines;
+};
+
+void ScanAdd(struct LineScan* scan, size_t offset) {
+    if (scan->count == scan->cap) {
+        scan->cap = (scan->cap == 0) ? 4096 : scan->cap * 2;
+        scan->nl = realloc(scan->nl, scan->cap * sizeof(size_t));
+    }
+    scan->nl[scan->count++] = offset;
+}
+
+void ScanScalar(struct LineScan* scan) {
+    char* end = &scan->buf[scan->to];
+    for (char* ptr = &scan->buf[scan->from]; (ptr = memchr(ptr, '\n', end - ptr)) != NULL; ++ptr) {
+        ScanAdd(scan, ptr - scan->buf);
+    }
+}
+
+#ifdef SEARCH_SIMD
+// newline kernels compare a whole block at once and walk the set bits of the match mask,
+// which beats one memchr call per line on the short lines of logs and source files
+void ScanSse2(struct LineScan* scan) {
+    __m128i nl = _mm_set1_epi8('\n');
+    size_t i = scan->from;
+    for (; i + 16 <= scan->to; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)&scan->buf[i]);
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, nl));
+        while (mask != 0) {
+            ScanAdd(scan, i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    for (; i < scan->to; ++i) {
+        if (scan->buf[i] == '\n') ScanAdd(scan, i);
+    }
+}
+
+__attribute__((target("avx2")))
+void ScanAvx2(struct LineScan* scan) {
+    __m256i nl = _mm256_set1_epi8('\n');
+    size_t i = scan->from;
+    for (; i + 32 <= scan->to; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)&scan->buf[i]);
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl));
+        while (mask != 0) {
+            ScanAdd(scan, i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    for (; i < scan->to; ++i) {
+        if (scan->buf[i] == '\n') ScanAdd(scan, i);
+    }
+}
+#endif
+
+void (*scanKernel)(struct LineScan*) = ScanScalar;
+
+void ScanInit(void) {
+#ifdef SEARCH_SIMD
+    __builtin_cpu_init();
+    scanKernel = __builtin_cpu_supports("avx2") ? ScanAvx2 : ScanSse2;
+#endif
+}
+
+void* ScanWorkerFind(void* arg) {
+    scanKernel((struct LineScan*)arg);
+    return NULL;
+}
+
+// turns the scanned line boundaries into view lines, each worker fills its own slots; the blocks
+// are walked directly, as the line iterators keep the recently touched order of the main thread
+void* ScanWorkerFill(void* arg) {
+    struct LineScan* scan = (struct LineScan*)arg;
+
+    int rank, index;
+    struct LineBlock* block = BlockLocate(scan->line, &rank, &index);
+    size_t start = scan->start;
+    for (int i = 0; i < scan->lines; ++i) {
+        size_t end = (i < scan->count) ? scan->nl[i] : scan->to;
+        size_t len = end - start;
+        while (len > 0 && scan->buf[start + len - 1] == '\r') --len;
+
+        if (index == block->count) {
+            block = block->next;
+            index = 0;
+        }
+        EditorInitViewLine(&block->line[index++], &scan->buf[start], (int)len);
+        start = end + 1;
+    }
+    return NULL;
+}
+
+void ScanAppendRange(size_t from, size_t to, int count, long long bytes) {
+    // the last line's separator isn't part of the range
+    while (to > from && config.map[to - 1] == '\r') --to;
+
+    struct ColdBlock* cold = (struct ColdBlock*)malloc(sizeof(struct ColdBlock));
+    cold->offset = from;
+    cold->len = (int)(to - from);
+    cold->packed = 0;
+    cold->raw = 1;
+    cold->states = 0;
+    DocumentAppendCold(cold, count, bytes);
+}
+
+// lines of the mapping go straight into cold blocks of the ranges they span, as views are only
+// made of the ones that are shown
+void ScanAppendRanges(struct LineScan* scan, int threads) {
+    int count = 0;
+    long long bytes = 0; // of the lines without their carriage returns
+    size_t first = 0;
+    size_t last = 0;
+    for (int i = 0; i < threads; ++i) {
+        size_t start = scan[i].start;
+        for (int k = 0; k < scan[i].lines; ++k) {
+            size_t end = (k < scan[i].count) ? scan[i].nl[k] : scan[i].to;
+            size_t len = end - start;
+            while (len > 0 && config.map[start + len - 1] == '\r') --len;
+            bytes += len + 1;
+
+            if (count == 0) first = start;
+            last = end;
+            if (++count == LINE_BLOCK_MAX || last - first >= COLD_MAX_TEXT / 2) {
+                ScanAppendRange(first, last, count, bytes);
+                count = 0;
+                bytes = 0;
+            }
+            start = end + 1;
+        }
+    }
+    if (count > 0) ScanAppendRange(first, last, count, bytes);
+}
+
+void ScanRun(struct LineScan* scan, int threads, void* (*worker)(void*)) {
+    for (int i = 1; i < threads; ++i) {
+        scan[i].started = pthread_create(&scan[i].thread, NULL, worker, &scan[i]) == 0;
+    }
+    worker(&scan[0]);
+    for (int i = 1; i < threads; ++i) {
+        if (scan[i].started) {
+            pthread_join(scan[i].thread, NULL);
+        }
+        else {
+            worker(&scan[i]);
+        }
+    }
+}
+
+// appends the lines in buf[from, to), finding newlines on all cores and building them there as views,
+// or as cold ranges when buf is the mapping; returns where the unfinished line after the last
+// newline starts, unless `eof`
+size_t EditorScanLines(char* buf, size_t from, size_t to, int eof) {
+    if (from >= to) return to;
+
+    int threads = (to - from) / SCAN_MIN_BYTES + 1;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > cores) threads = (cores < 1) ? 1 : cores;
+    if (threads > SCAN_MAX_THREADS) threads = SCAN_MAX_THREADS;
+
+    struct LineScan scan[SCAN_MAX_THREADS];
+    size_t per = (to - from + threads - 1) / threads;
+    for (int i = 0; i < threads; ++i) {
+        memset(&scan[i], 0, sizeof(struct LineScan));
+        scan[i].buf = buf;
+        scan[i].from = from + i * per;
+        scan[i].to = (from + (i + 1) * per < to) ? from + (i + 1) * per : to;
+    }
+    ScanRun(scan, threads, ScanWorkerFind);
+
+    // merge the per-range tables: each worker gets the lines ending at its newlines, the last
+    // one also gets the unterminated line at the end of the input
+    int lines = 0;
+    size_t start = from;
+    for (int i = 0; i < threads; ++i) {
+        scan[i].line = config.lines + lines;
+        scan[i].start = start;
+        scan[i].lines = scan[i].count;
+        if (scan[i].count > 0) start = scan[i].nl[scan[i].count - 1] + 1;
+        lines += scan[i].count;
+    }
+    if (eof && start < to) {
+        ++scan[threads - 1].lines;
+        ++lines;
+        start = to;
+    }
+
+    if (lines > 0 && buf == config.map) {
+        SearchInvalidate();
+        ScanAppendRanges(scan, threads);
+    }
+    else if (lines > 0) {
+        SearchInvalidate();
+        DocumentAppendLines(lines);
+        ScanRun(scan, threads, ScanWorkerFill);
+        int rank, index;
+        for (struct LineBlock* block = BlockLocate(scan[0].line, &rank, &index); block != NULL; block = block->next) {
+            BlockResize(block);
+        }
+        ColdEvict();
+    }
+
+    for (int i = 0; i < threads; ++i) free(scan[i].nl);
+    return start;
+}
+
+/*** loader ***/
+
+// packs the lines in buf[from, to) into blocks like cold ones, so what was read doesn't have to be
+// kept; the lines end in newlines, but for an unterminated last one when the file ended
+void LoaderQueue(struct Loader* loader, char* buf, size_t from, size_t to, size_t bytes, int done) {
+    struct LoadChunk* first = NULL;
+    struct LoadChunk* last = NULL;
+    while (from < to) {
+        int count = 0;
+        long long chunkBytes = 0;
+        size_t end = from;
+        size_t next = from;
+        while (next < to && count < LINE_BLOCK_MAX && (count == 0 || next - from < COLD_MAX_TEXT / 2)) {
+            char* nl = memchr(&buf[next], '\n', to - next);
+            end = (nl == NULL) ? to : (size_t)(nl - buf);
+            size_t len = end - next;
+            while (len > 0 && buf[next + len - 1] == '\r') --len;
+            chunkBytes += len + 1;
+            next = (nl == NULL) ? to : end + 1;
+            ++count;
+        }
+
+        struct LoadChunk* chunk = (struct LoadChunk*)malloc(sizeof(struct LoadChunk));
+        chunk->next = NULL;
+        chunk->cold = ColdCompress(&buf[from], (int)(end - from), 0, 1);
+        chunk->count = count;
+        chunk->bytes = chunkBytes;
+        if (last != NULL) last->next = chunk;
+        else first = chunk;
+        last = chunk;
+        from = next;
+    }
+
+    pthread_mutex_lock(&loader->lock);
+    if (first != NULL && loader->last != NULL) loader->last->next = first;
+    else if (first != NULL) loader->first = first;
+    if (first != NULL) loader->last = last;
+    loader->bytes = bytes;
+    loader->done = done;
+    pthread_cond_signal(&loader->cond);
+    pthread_mutex_unlock(&loader->lock);
+
+    // the pipe being full already means a wake up is pending
+    write(loader->notify[1], "", 1);
+}
+
+int LoaderMoreReady(int fd) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+// reads a slab at a time, handing complete lines over packed once a batch gathered or the source
+// has nothing more right now; what was handed over is dropped, so the slab is read into again
+void* LoaderRun(void* arg) {
+    struct Loader* loader = (struct Loader*)arg;
+    size_t size = ARENA_SLAB;
+    char* buf = (char*)malloc(size);
+    size_t used = 0;
+    size_t start = 0;
+    size_t complete = 0;
+    size_t bytes = 0;
+
+    while (1) {
+        if (used == size) {
+            // keep only the unfinished line, growing the slab when a long line has filled most of it
+            size_t partial = used - start;
+            memmove(buf, &buf[start], partial);
+            if (partial * 2 > size) {
+                size *= 2;
+                buf = (char*)realloc(buf, size);
+            }
+            used = partial;
+            complete -= start;
+            start = 0;
+        }
+
+        ssize_t got = read(loader->fd, &buf[used], size - used);
+        if (got == -1 && errno == EINTR) continue;
+        if (got <= 0) {
+            pthread_mutex_lock(&loader->lock);
+            loader->error = (got == -1) ? errno : 0;
+            pthread_mutex_unlock(&loader->lock);
+            break;
+        }
+
+        // only the new bytes are searched, so a long line arriving in pieces isn't scanned again and again
+        size_t end = used + got;
+        for (size_t i = end; i > used; --i) {
+            if (buf[i - 1] == '\n') {
+                complete = i;
+                break;
+            }
+        }
+        used = end;
+        bytes += got;
+
+        if (complete > start && (complete - start >= LOAD_BATCH || !LoaderMoreReady(loader->fd))) {
+            LoaderQueue(loader, buf, start, complete, bytes, 0);
+            start = complete;
+        }
+    }
+    LoaderQueue(loader, buf, start, used, bytes, 1);
+    free(buf);
+    return NULL;
+}
+
+void LoaderReady(void);
+
+void LoaderStart(int fd) {
+    struct Loader* loader = &config.loader;
+    loader->fd = fd;
+    loader->first = NULL;
+    loader->last = NULL;
+    loader->bytes = 0;
+    loader->done = 0;
+    loader->error = 0;
+    if (pipe(loader->notify) == -1) Die("pipe");
+    for (int i = 0; i < 2; ++i) {
+        fcntl(loader->notify[i], F_SETFL, O_NONBLOCK);
+        fcntl(loader->notify[i], F_SETFD, FD_CLOEXEC);
+    }
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->cond, NULL);
+
+    loader->active = 1;
+    if (pthread_create(&loader->thread, NULL, LoaderRun, loader) != 0) Die("pthread_create");
+    EventWatch(loader->notify[0], LoaderReady);
+}
+
+void LoaderEnd(void) {
+    struct Loader* loader = &config.loader;
+    pthread_join(loader->thread, NULL);
+    close(loader->fd);
+    EventUnwatch(loader->notify[0]);
+    close(loader->notify[0]);
+    close(loader->notify[1]);
+    pthread_mutex_destroy(&loader->lock);
+    pthread_cond_destroy(&loader->cond);
+
+    loader->active = 0;
+    config.fileBytes = loader->bytes;
+
+    if (loader->error != 0) EditorSetMessage("Can't read the whole file! I/O error: %s", strerror(loader->error));
+}
+
+// adds the lines handed over so far, waiting for some when `wait`; returns 1 once the load finished
+int LoaderTake(int wait) {
+    struct Loader* loader = &config.loader;
+    pthread_mutex_lock(&loader->lock);
+    while (wait && loader->first == NULL && !loader->done) pthread_cond_wait(&loader->cond, &loader->lock);
+    struct LoadChunk* chunk = loader->first;
+    loader->first = NULL;
+    loader->last = NULL;
+    int done = loader->done;
+    pthread_mutex_unlock(&loader->lock);
+
+    if (chunk != NULL) SearchInvalidate();
+    while (chunk != NULL) {
+        DocumentAppendCold(chunk->cold, chunk->count, chunk->bytes);
+        struct LoadChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    if (done) LoaderEnd();
+    return done;
+}
+
+void LoaderReady(void) {
+    char drain[64];
+    while (read(config.loader.notify[0], drain, sizeof(drain)) > 0);
+    if (config.loader.active == 0) return;
+
+    LoaderTake(0);
+    EditorRefreshScreen();
+}
+
+void LoaderFinish(void) {
+    while (config.loader.active && LoaderTake(1) == 0);
+}
+
+int EditorLoadProgress(char* buf, int size) {
+    if (config.mapIndexed < config.mapLen) {
+        return snprintf(buf, size, " (%d%%)", (int)(config.mapIndexed * 100 / config.mapLen));
+    }
+    if (config.loader.active) {
+        pthread_mutex_lock(&config.loader.lock);
+        size_t bytes = config.loader.bytes;
+        pthread_mutex_unlock(&config.loader.lock);
+        return snprintf(buf, size, " (%zu MB)", bytes >> 20);
+    }
+    buf[0] = '\0';
+    return 0;
+}
+
+/*** file i/o ***/
+
+int EditorIndexMapping(size_t bytes) {
+    int lines = config.lines;
+    size_t end = config.mapIndexed + bytes;
+    if (end >= config.mapLen) {
+        end = config.mapLen;
+    }
+    else {
+        char* nl = memchr(&config.map[end], '\n', config.mapLen - end);
+        end = (nl == NULL) ? config.mapLen : (size_t)(nl - config.map) + 1;
+    }
+
+    config.mapIndexed = EditorScanLines(config.map, config.mapIndexed, end, end == config.mapLen);
+    return config.lines - lines;
+}
+
+// makes sure the first `lines` lines of the mapped file are indexed, stepping up from a small
+// first chunk so the first screen doesn't wait for a whole step
+void EditorIndexLines(int lines) {
+    size_t bytes = EDITOR_INDEX_FIRST;
+    while (config.lines < lines && config.mapIndexed < config.mapLen) {
+        EditorIndexMapping(bytes);
+        if (bytes < EDITOR_INDEX_CHUNK) bytes *= 2;
+    }
+}
+
+void EditorIndexBytes(long long offset) {
+    while (BlockTotalBytes(config.root) <= offset && config.mapIndexed < config.mapLen) {
+        EditorIndexMapping(EDITOR_INDEX_CHUNK);
+    }
+}
+
+// the rest of a stream may never arrive, so this only takes what the loader has handed over
+void EditorIndexLoaded(void) {
+    while (config.mapIndexed < config.mapLen) {
+        EditorIndexMapping(EDITOR_INDEX_CHUNK);
+    }
+    if (config.loader.active) LoaderTake(0);
+}
+
+void EditorIndexAll(void) {
+    EditorIndexLoaded();
+    LoaderFinish();
+}
+
+// the pages of the mapping from `offset` on read as zeros from now on, `offset` being a page boundary;
+// called from the SIGBUS handler too
+int MapZero(size_t offset) {
+    int fd = open("/dev/zero", O_RDONLY);
+    if (fd == -1) return -1;
+    void* zero = mmap(&config.map[offset], config.mapLen - offset, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    close(fd);
+    return (zero == MAP_FAILED) ? -1 : 0;
+}
+
+// reading a page the file no longer reaches raises SIGBUS, the text there is lost but the editor goes on
+void MapOnFault(int sig, siginfo_t* info, void* context) {
+    (void)context;
+    char* addr = (char*)info->si_addr;
+    if (config.map != NULL && addr >= config.map && addr < &config.map[config.mapLen]) {
+        size_t offset = (addr - config.map) & ~(size_t)(config.mapPage - 1);
+        if (MapZero(offset) == 0) {
+            config.mapFault = 1;
+            return;
+        }
+    }
+    signal(sig, SIG_DFL);
+}
+
+int EditorOpenMapped(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) return -1;
+
+    char* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return -1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = MapOnFault;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_SIGINFO;
+    sigaction(SIGBUS, &sa, NULL);
+
+    config.map = map;
+    config.mapLen = st.st_size;
+    config.mapIndexed = 0;
+    config.mapFd = fd;
+    config.mapMtime = st.st_mtim;
+    config.mapPage = sysconf(_SC_PAGESIZE);
+    config.mapFault = 0;
+    return 0;
+}
+
+void EditorUnmap(void) {
+    munmap(config.map, config.mapLen);
+    close(config.mapFd);
+    config.map = NULL;
+    config.mapLen = 0;
+    config.mapIndexed = 0;
+    config.mapFd = -1;
+    config.mapFault = 0;
+}
+
+// gives the document its own copy of the text it reads from the mapping: cold ranges of it are
+// packed and the lines viewing it copied, so the file is free to change
+void EditorDetachMapping(void) {
+    if (config.map == NULL) return;
+    EditorIndexAll();
+
+    char* end = &config.map[config.mapLen];
+    for (struct LineBlock* block = config.firstBlock; block != NULL; block = block->next) {
+        struct ColdBlock* cold = block->cold;
+        if (cold != NULL && cold->packed == 0) {
+            block->cold = ColdCompress(&config.map[cold->offset], cold->len, cold->states, 1);
+            ++allocations;
+            memcpy(block->cold->data, cold->data, cold->states);
+            free(cold);
+        }
+        for (int i = 0; block->line != NULL && i < block->count; ++i) {
+            struct EditorLine* line = &block->line[i];
+            if (line->str.buf >= config.map && line->str.buf <= end) EditorLineOwn(line);
+        }
+    }
+    EditorUnmap();
+}
+
+// called before a key is handled: once the mapped file shrank, the pages past its end are given zeros
+// before anything reads them and the document lets go of the mapping; a file rewritten in place
+// can't be told from one appended to, it only gets a warning
+void EditorCheckMapping(void) {
+    struct stat st;
+    if (config.map == NULL || config.follow.active || fstat(config.mapFd, &st) == -1) return;
+
+    if ((size_t)st.st_size < config.mapLen || config.mapFault) {
+        size_t size = ((size_t)st.st_size < config.mapLen) ? (size_t)st.st_size : config.mapLen;
+        size_t keep = (size + config.mapPage - 1) & ~(size_t)(config.mapPage - 1);
+        if (keep < config.mapLen) MapZero(keep);
+        // what the file still holds is split into lines, the zeros after it aren't
+        if (config.mapIndexed < size) EditorScanLines(config.map, config.mapIndexed, size, 1);
+        config.mapIndexed = config.mapLen;
+        EditorDetachMapping();
+        EditorSetMessage("%.40s was truncated, the text past byte %lld is lost", config.fileName, (long long)st.st_size);
+    }
+    else if (st.st_mtim.tv_sec != config.mapMtime.tv_sec || st.st_mtim.tv_nsec != config.mapMtime.tv_nsec) {
+        config.mapMtime = st.st_mtim;
+        EditorSetMessage("%.40s changed on disk, parts not read yet may show the new text", config.fileName);
+    }
+}
+
+// takes the document from `fd`: only the first screen of a mapped file is split now and the rest on
+// demand or while idle, anything else streams in on the loader thread, which then owns `fd`
+void EditorLoad(int fd) {
+    if (EditorOpenMapped(fd) == 0) {
+        EditorIndexLines(config.rows + 1);
+        config.fileBytes = config.mapLen;
+    }
+    else {
+        LoaderStart(fd);
+    }
+}
+
+void EditorOpen(const char* fileName) {
+    long long start = ProfBegin();
+    free(config.fileName);
+    config.fileName = strdup(fileName);
+
+    int fd = open(fileName, O_RDONLY);
+    if (fd == -1) Die("open");
+    EditorLoad(fd);
+
+    config.dirty = 0;
+    EditorSelectSyntax();
+#ifndef EDITOR_BENCH
+    // the benchmark only ever journals to its scratch file, a recovery journal of its input is left alone
+    JournalReplay();
+#endif
+    ProfEnd(PROF_OPEN, start);
+}
+
+int WriteVector(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+long long EditorWriteLines(int fd) {
+    struct iovec iov[SAVE_BATCH];
+    int count = 0;
+    long long bytes = 0;
+    int error = 0;
+    char* buf = NULL;
+    int cap = 0;
+
+    // the blocks are walked directly, cold ones written from their text rather than thawed
+    for (struct LineBlock* block = config.firstBlock; block != NULL && !error; block = block->next) {
+        struct ColdBlock* cold = block->cold;
+        char* text = NULL;
+        char* end = NULL;
+        if (block->line == NULL) {
+            if (cold->packed > 0) {
+                // what is queued may still point into the buffer
+                error = WriteVector(fd, iov, count) == -1;
+                count = 0;
+                if (cold->len > cap) {
+                    cap = cold->len;
+                    free(buf);
+                    buf = malloc(cap);
+                }
+            }
+            text = ColdText(cold, buf);
+            end = &text[cold->len];
+        }
+
+        for (int i = 0; i < block->count && !error; ++i) {
+            if (count + 3 > SAVE_BATCH) {
+                error = WriteVector(fd, iov, count) == -1;
+                count = 0;
+            }
+            if (text != NULL) {
+                int len;
+                char* nl = ColdNextLine(cold, text, end, &len);
+                iov[count].iov_base = text;
+                iov[count++].iov_len = len;
+                bytes += len + 1;
+                text = nl + 1;
+            }
+            else {
+                struct EditorLine* line = &block->line[i];
+                if (line->gap > 0) {
+                    iov[count].iov_base = line->str.buf;
+                    iov[count++].iov_len = line->gap;
+                }
+                if (line->str.len > line->gap) {
+                    iov[count].iov_base = LineTail(line);
+                    iov[count++].iov_len = line->str.len - line->gap;
+                }
+                bytes += line->str.len + 1;
+            }
+            iov[count].iov_base = "\n";
+            iov[count++].iov_len = 1;
+        }
+    }
+    if (!error) error = WriteVector(fd, iov, count) == -1;
+    free(buf);
+    return error ? -1 : bytes;
+}
+
+void SyncDirectory(const char* path) {
+    const char* slash = strrchr(path, '/');
+    char* dir = (slash == NULL) ? strdup(".") : strndup(path, (slash == path) ? 1 : slash - path);
+    int fd = open(dir, O_RDONLY);
+    if (fd != -1) {
+        fsync(fd);
+        close(fd);
+    }
+    free(dir);
+}
+
+// writes a temporary file next to the target and renames it over, so a crash never leaves
+// a truncated file and the old inode stays alive for any mapping still viewing it; a symlink
+// is followed to the file it names, and a writable file in a directory that isn't is
+// overwritten in place instead
+void EditorSave(void) {
+    if (config.loader.active) {
+        EditorSetMessage("Can't save before the whole file is read");
+        return;
+    }
+    if (config.fileName == NULL) {
+        config.fileName = EditorPrompt("Save as: %s", NULL);
+        if (config.fileName == NULL) {
+            EditorSetMessage("Save aborted");
+            return;
+        }
+        EditorSelectSyntax();
+    }
+    long long profStart = ProfBegin();
+    EditorIndexAll();
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    char* path = realpath(config.fileName, NULL);
+    if (path == NULL) path = strdup(config.fileName);
+
+    struct stat st;
+    int exists = stat(path, &st) == 0;
+    mode_t mode = exists ? st.st_mode & 07777 : 0644;
+
+    int len = strlen(path);
+    char* tmpName = malloc(len + sizeof(SAVE_SUFFIX));
+    memcpy(tmpName, path, len);
+    memcpy(&tmpName[len], SAVE_SUFFIX, sizeof(SAVE_SUFFIX));
+
+    int fd = mkstemp(tmpName);
+    if (fd == -1 && errno == EACCES) {
+        // the document may still read from the file about to be truncated
+        EditorDetachMapping();
+        free(tmpName);
+        tmpName = NULL;
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd == -1) {
+        EditorSetMessage("Can't save! I/O error: %s", strerror(errno));
+        free(tmpName);
+        free(path);
+        ProfEnd(PROF_SAVE, profStart);
+        return;
+    }
+
+    long long bytes = EditorWriteLines(fd);
+    int saved = bytes != -1;
+    if (saved && tmpName != NULL) {
+        // only root may give a file away, anyone else saves it as their own
+        saved = (!exists || fchown(fd, st.st_uid, st.st_gid) != -1 || errno == EPERM) && fchmod(fd, mode) != -1;
+    }
+    if (saved) saved = fsync(fd) != -1;
+    if (close(fd) == -1) saved = 0;
+    if (saved && tmpName != NULL) {
+        saved = rename(tmpName, path) != -1;
+        if (saved) SyncDirectory(path);
+    }
+
+    if (saved) {
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        double mbps = (seconds > 0) ? bytes / seconds / (1 << 20) : 0;
+
+        config.dirty = 0;
+        config.fileBytes = bytes;
+        config.undo.savedSeq = UndoSeq(&config.undo);
+        config.undo.open = NULL;
+        JournalDiscard();
+        EditorSetMessage("%lld bytes written to disk (%.1f MB/s)", bytes, mbps);
+    }
+    else {
+        EditorSetMessage("Can't save! I/O error: %s", strerror(errno));
+        if (tmpName != NULL) unlink(tmpName);
+    }
+    free(tmpName);
+    free(path);
+    ProfEnd(PROF_SAVE, profStart);
+}
+
+/*** journal ***/
+
+// dir/name becomes dir/.name.kswp
+char* JournalPath(const char* fileName) {
+    const char* slash = strrchr(fileName, '/');
+    int dirLen = (slash == NULL) ? 0 : slash - fileName + 1;
+    int len = strlen(fileName);
+    char* path = malloc(len + 2 + sizeof(JOURNAL_SUFFIX));
+    snprintf(path, len + 2 + sizeof(JOURNAL_SUFFIX), "%.*s.%s%s", dirLen, fileName, &fileName[dirLen], JOURNAL_SUFFIX);
+    return path;
+}
+
+void JournalHeaderInit(struct JournalHeader* header) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, JOURNAL_MAGIC, sizeof(header->magic));
+
+    struct stat st;
+    if (stat(config.fileName, &st) == 0) {
+        header->size = st.st_size;
+        header->mtime = st.st_mtim.tv_sec;
+        header->mtimeNsec = st.st_mtim.tv_nsec;
+    }
+}
+
+int JournalWrite(int fd, const char* buf, int len) {
+    while (len > 0) {
+        int written = write(fd, buf, len);
+        if (written == -1 && errno == EINTR) continue;
+        if (written == -1) return -1;
+        buf += written;
+        len -= written;
+    }
+    return 0;
+}
+
+int JournalOpen(struct Journal* journal) {
+    if (journal->fd != -1) return 0;
+
+    free(journal->path);
+    journal->path = JournalPath(config.fileName);
+    journal->fd = open(journal->path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (journal->fd == -1) return -1;
+
+    struct JournalHeader header;
+    JournalHeaderInit(&header);
+    journal->syncTime = MonotonicMs();
+    return JournalWrite(journal->fd, (char*)&header, sizeof(header));
+}
+
+void JournalRecord(int kind, int newLine, int y, int x, const char* text, int len) {
+    struct Journal* journal = &config.journal;
+    if (journal->replaying || config.fileName == NULL) return;
+
+    struct JournalEntry entry = { kind, newLine, y, x, len };
+    StringAppend(&journal->pending, (char*)&entry, sizeof(entry));
+    StringAppend(&journal->pending, text, len);
+    if (journal->pending.len >= JOURNAL_BATCH) JournalCommit();
+}
+
+// syncs what was written once JOURNAL_SYNC_MS passed since the last sync, so bursts of edits share one
+void JournalTick(void) {
+    struct Journal* journal = &config.journal;
+    if (journal->unsynced == 0) return;
+
+    long long now = MonotonicMs();
+    if (now - journal->syncTime < JOURNAL_SYNC_MS) return;
+
+    fdatasync(journal->fd);
+    journal->syncTime = now;
+    journal->unsynced = 0;
+}
+
+void JournalCommit(void) {
+    struct Journal* journal = &config.journal;
+    if (journal->pending.len > 0) {
+        if (JournalOpen(journal) == -1 || JournalWrite(journal->fd, journal->pending.buf, journal->pending.len) == -1) {
+            EditorSetMessage("Can't write swap file! I/O error: %s", strerror(errno));
+        }
+        else {
+            journal->unsynced = 1;
+        }
+        StringTruncate(&journal->pending, 0);
+    }
+    JournalTick();
+    if (journal->unsynced) EventSetTimer(TIMER_JOURNAL, journal->syncTime + JOURNAL_SYNC_MS, JournalTick);
+}
+
+void JournalDiscard(void) {
+    struct Journal* journal = &config.journal;
+    if (journal->fd != -1) {
+        close(journal->fd);
+        unlink(journal->path);
+        journal->fd = -1;
+    }
+    StringTruncate(&journal->pending, 0);
+    journal->unsynced = 0;
+}
+
+// a record from a torn or foreign journal must not reach past the document
+int JournalValid(struct JournalEntry* entry, const char* text) {
+    if (entry->len < 0 || entry->y < 0 || entry->x < 0 || entry->y > config.lines) return 0;
+    if (entry->kind == UNDO_INSERT && entry->newLine) return entry->y == config.lines && entry->x == 0;
+    if (entry->y == config.lines) return entry->kind == UNDO_INSERT && entry->x == 0;
+
+    if (entry->x > DocumentLine(entry->y)->str.len) return 0;
+    if (entry->kind == UNDO_INSERT) return 1;
+
+    int y = entry->y;
+    int lastLen = entry->x + entry->len;
+    for (int i = 0; i < entry->len; ++i) {
+        if (text[i] == '\n') {
+            ++y;
+            lastLen = entry->len - i - 1;
+        }
+    }
+    // removing an appended line takes the last line with it
+    if (entry->newLine && (entry->x != 0 || y != config.lines - 1)) return 0;
+    return y < config.lines && lastLen <= DocumentLine(y)->str.len;
+}
+
+// applies the edits left by a session that ended without saving, as long as they were made on this version of the file
+void JournalReplay(void) {
+    struct Journal* journal = &config.journal;
+    char* path = JournalPath(config.fileName);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        free(path);
+        return;
+    }
+
+    struct stat st;
+    char* buf = NULL;
+    size_t size = 0;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(struct JournalHeader)) {
+        buf = malloc(st.st_size);
+        ssize_t bytesRead;
+        while (size < (size_t)st.st_size && (bytesRead = read(fd, &buf[size], st.st_size - size)) > 0) size += bytesRead;
+    }
+    close(fd);
+
+    struct JournalHeader header;
+    JournalHeaderInit(&header);
+    if (size < sizeof(header) || memcmp(buf, &header, sizeof(header)) != 0) {
+        EditorSetMessage("Ignoring %.40s, it doesn't match the file", path);
+        free(buf);
+        free(path);
+        return;
+    }
+
+    EditorIndexAll();
+
+    journal->replaying = 1;
+    int count = 0;
+    size_t at = sizeof(header);
+    while (at + sizeof(struct JournalEntry) <= size) {
+        struct JournalEntry entry;
+        memcpy(&entry, &buf[at], sizeof(entry));
+        char* text = &buf[at + sizeof(entry)];
+        if (entry.len < 0 || at + sizeof(entry) + entry.len > size || JournalValid(&entry, text) == 0) break;
+
+        EditorApplyEdit(entry.kind, entry.newLine, entry.y, entry.x, text, entry.len);
+        at += sizeof(entry) + entry.len;
+        ++count;
+    }
+    journal->replaying = 0;
+    free(buf);
+
+    // new records follow the last complete one, a torn tail is cut off
+    free(journal->path);
+    journal->path = path;
+    journal->fd = open(path, O_WRONLY);
+    if (journal->fd != -1 && (ftruncate(journal->fd, at) == -1 || lseek(journal->fd, 0, SEEK_END) == -1)) {
+        close(journal->fd);
+        journal->fd = -1;
+    }
+    journal->syncTime = MonotonicMs();
+
+    config.dirty = count;
+    if (count > 0) EditorSetMessage("Recovered %d edits from %.40s", count, path);
+}
+
+/*** follow ***/
+
+void FollowAppend(char* buf, size_t from, size_t to) {
+    struct Follow* follow = &config.follow;
+    if (follow->open && config.lines > 0) {
+        char* nl = memchr(&buf[from], '\n', to - from);
+        size_t end = (nl == NULL) ? to : (size_t)(nl - buf);
+        size_t len = end - from;
+        if (nl != NULL && len > 0 && buf[end - 1] == '\r') --len;
+
+        EditorLineAppendString(DocumentLine(config.lines - 1), &buf[from], len);
+        HighlightInvalidate(config.lines - 1);
+        SearchInvalidate();
+        if (nl == NULL) return;
+        from = end + 1;
+    }
+    EditorScanLines(buf, from, to, 1);
+    follow->open = from < to && buf[to - 1] != '\n';
+}
+
+void FollowReset(void) {
+    struct Follow* follow = &config.follow;
+    EditorClear();
+    UndoClear(&config.undo);
+    if (config.map != NULL) EditorUnmap();
+    follow->offset = 0;
+    follow->open = 0;
+    config.x = 0;
+    config.y = 0;
+    config.rowOffset = 0;
+    config.colOffset = 0;
+}
+
+// packs the blocks from line `first` on like the loader's, so none of their lines views the buffer
+// about to be read into again; lines of blocks too big to pack get copies instead
+void FollowPack(int first) {
+    char* buf = config.follow.buf;
+    int rank, index;
+    for (struct LineBlock* block = BlockLocate(first, &rank, &index); block != NULL; block = block->next) {
+        if (block->line == NULL || BlockFreeze(block)) continue;
+        for (int i = 0; i < block->count; ++i) {
+            struct EditorLine* line = &block->line[i];
+            if (line->str.buf >= buf && line->str.buf < &buf[ARENA_SLAB]) EditorLineOwn(line);
+        }
+    }
+}
+
+void FollowRead(void) {
+    struct Follow* follow = &config.follow;
+    struct stat st;
+    if (follow->fd == -1 || fstat(follow->fd, &st) == -1) return;
+    if (st.st_size < follow->offset) {
+        FollowReset();
+        EditorSetMessage("%.40s was truncated", config.fileName);
+    }
+
+    while (1) {
+        ssize_t got = pread(follow->fd, follow->buf, ARENA_SLAB, follow->offset);
+        if (got == -1 && errno == EINTR) continue;
+        if (got <= 0) break;
+        int first = config.lines;
+        FollowAppend(follow->buf, 0, got);
+        FollowPack(first);
+        follow->offset += got;
+    }
+    config.fileBytes = follow->offset;
+}
+
+void FollowWatch(void) {
+#ifdef __linux__
+    struct Follow* follow = &config.follow;
+    if (follow->notify == -1) return;
+    if (follow->watch != -1) inotify_rm_watch(follow->notify, follow->watch);
+    follow->watch = inotify_add_watch(follow->notify, config.fileName, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+#endif
+}
+
+void FollowUpdate(void) {
+    struct Follow* follow = &config.follow;
+    if (follow->active == 0) return;
+    if (follow->notify != -1) {
+        char events[4096];
+        while (read(follow->notify, events, sizeof(events)) > 0);
+    }
+
+    int pinned = config.y >= config.lines - 1;
+    FollowRead();
+
+    // after a rotation the name belongs to another file, which is followed once the old one is drained
+    struct stat st, named;
+    int exists = stat(config.fileName, &named) == 0;
+    if (exists && (fstat(follow->fd, &st) == -1 || st.st_ino != named.st_ino || st.st_dev != named.st_dev)) {
+        close(follow->fd);
+        follow->fd = open(config.fileName, O_RDONLY);
+        follow->offset = 0;
+        follow->open = 0;
+        FollowWatch();
+        FollowRead();
+        EditorSetMessage("%.40s was replaced, following the new file", config.fileName);
+    }
+
+    if (pinned && config.lines > 0) {
+        config.y = config.lines - 1;
+        config.x = 0;
+    }
+    if (follow->notify == -1 || !exists) EventSetTimer(TIMER_FOLLOW, MonotonicMs() + FOLLOW_POLL_MS, FollowUpdate);
+    EditorRefreshScreen();
 }
 
-void EditorLineDeleteChar(struct EditorLine* line, int at) {
-    struct String* str = &line->str;
-    if (at < 0 || at >= str->len) return;
+void FollowStart(void) {
+    struct Follow* follow = &config.follow;
+    if (config.fileName == NULL || config.dirty) {
+        EditorSetMessage("Only a saved file can be followed");
+        return;
+    }
 
-    memmove(&str->buf[at], &str->buf[at + 1], str->len - at - 1);
-    --str->len;
+    struct stat st;
+    follow->fd = open(config.fileName, O_RDONLY);
+    if (follow->fd == -1 || fstat(follow->fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        EditorSetMessage("Can't follow %.40s", config.fileName);
+        if (follow->fd != -1) close(follow->fd);
+        return;
+    }
+    // a regular file has an end for the loader to reach
+    EditorIndexAll();
+
+    follow->buf = malloc(ARENA_SLAB);
+    ++allocations;
+    char last = '\n';
+    follow->offset = config.fileBytes;
+    follow->open = follow->offset > 0 && pread(follow->fd, &last, 1, follow->offset - 1) == 1 && last != '\n';
+    follow->active = 1;
+    follow->notify = -1;
+    follow->watch = -1;
+#ifdef __linux__
+    follow->notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (follow->notify != -1) {
+        FollowWatch();
+        EventWatch(follow->notify, FollowUpdate);
+    }
+#endif
 
-    EditorUpdateLine(line);
-    ++config.dirty;
+    if (config.lines > 0) config.y = config.lines - 1;
+    config.x = 0;
+    EditorSetMessage("Following %.40s read-only, Ctrl-T stops", config.fileName);
+    FollowUpdate();
 }
 
-/*** editor operations ***/
+void FollowStop(void) {
+    struct Follow* follow = &config.follow;
+    close(follow->fd);
+    if (follow->notify != -1) {
+        EventUnwatch(follow->notify);
+        close(follow->notify);
+    }
+    EventSetTimer(TIMER_FOLLOW, 0, NULL);
+    free(follow->buf);
+    follow->buf = NULL;
+    follow->active = 0;
+    EditorSetMessage("Stopped following %.40s", config.fileName);
+}
 
-void EditorInsertChar(int c) {
-    if (config.y == config.lines) {
-        EditorInsertLine(NULL, 0, config.lines);
+/*** search ***/
+
+int SearchScalar(const char* hay, int len, const char* needle, int nlen) {
+    const char* end = hay + len - nlen + 1;
+    for (const char* ptr = hay; ptr < end; ++ptr) {
+        ptr = memchr(ptr, needle[0], end - ptr);
+        if (ptr == NULL) return -1;
+        if (memcmp(ptr, needle, nlen) == 0) return ptr - hay;
     }
-    EditorLineInsertChar(&config.line[config.y], config.x, (char)c);
-    ++config.x;
+    return -1;
 }
 
-void EditorInsertNewLine(void) {
-    if (config.x == 0) {
-        EditorInsertLine(NULL, 0, config.y);
+#ifdef SEARCH_SIMD
+// both kernels compare the first and last byte of the needle against a block of candidate
+// positions at once and only memcmp the middle for the positions where both matched
+int SearchSse2(const char* hay, int len, const char* needle, int nlen) {
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[nlen - 1]);
+
+    int i = 0;
+    for (; i + nlen - 1 + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)&hay[i]);
+        __m128i b = _mm_loadu_si128((const __m128i*)&hay[i + nlen - 1]);
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if (nlen <= 2 || memcmp(&hay[i + bit + 1], &needle[1], nlen - 2) == 0) return i + bit;
+            mask &= mask - 1;
+        }
     }
-    else {
-        struct EditorLine* line = &config.line[config.y];
-        EditorInsertLine(&line->str.buf[config.x], line->str.len - config.x, config.y + 1);
 
-        line = &config.line[config.y];
-        StringTruncate(&line->str, config.x);
+    int at = SearchScalar(&hay[i], len - i, needle, nlen);
+    return (at == -1) ? -1 : i + at;
+}
 
-        EditorUpdateLine(line);
+__attribute__((target("avx2")))
+int SearchAvx2(const char* hay, int len, const char* needle, int nlen) {
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[nlen - 1]);
+
+    int i = 0;
+    for (; i + nlen - 1 + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)&hay[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i*)&hay[i + nlen - 1]);
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if (nlen <= 2 || memcmp(&hay[i + bit + 1], &needle[1], nlen - 2) == 0) return i + bit;
+            mask &= mask - 1;
+        }
     }
-    ++config.y;
-    config.x = 0;
+
+    int at = SearchScalar(&hay[i], len - i, needle, nlen);
+    return (at == -1) ? -1 : i + at;
 }
+#endif
 
-void EditorDeleteChar(void) {
-    if (config.y == config.lines) return;
-    if (config.x == 0 && config.y == 0) return;
+int (*searchKernel)(const char*, int, const char*, int) = SearchScalar;
 
-    struct EditorLine* line = &config.line[config.y];
-    if (config.x > 0) {
-        EditorLineDeleteChar(line, config.x - 1);
-        --config.x;
+void SearchInit(void) {
+#ifdef SEARCH_SIMD
+    __builtin_cpu_init();
+    searchKernel = __builtin_cpu_supports("avx2") ? SearchAvx2 : SearchSse2;
+#endif
+}
+
+int SearchFind(const char* hay, int len, const char* needle, int nlen) {
+    if (nlen == 0) return 0;
+    if (nlen > len) return -1;
+    return searchKernel(hay, len, needle, nlen);
+}
+
+int LineMatchAt(struct EditorLine* line, int at, const char* needle, int nlen) {
+    for (int i = 0; i < nlen; ++i) {
+        if (LineChar(line, at + i) != needle[i]) return 0;
     }
-    else {
-        struct EditorLine* prev = &config.line[config.y - 1];
-        config.x = prev->str.len;
-        EditorLineAppendString(prev, &line->str);
-        EditorDeleteLine(config.y);
-        --config.y;
+    return 1;
+}
+
+// finds `needle` in the line text at or after `from`, searching both sides of the gap in place
+int LineFind(struct EditorLine* line, int from, const char* needle, int nlen) {
+    int len = line->str.len;
+    if (from < 0) from = 0;
+    if (nlen > len - from) return -1;
+
+    if (from < line->gap) {
+        int at = SearchFind(&line->str.buf[from], line->gap - from, needle, nlen);
+        if (at != -1) return from + at;
+
+        // the few positions where a match would straddle the gap
+        int start = line->gap - nlen + 1;
+        if (start < from) start = from;
+        for (int i = start; i < line->gap && i + nlen <= len; ++i) {
+            if (LineMatchAt(line, i, needle, nlen)) return i;
+        }
+        from = line->gap;
     }
+
+    int at = SearchFind(&LineTail(line)[from - line->gap], len - from, needle, nlen);
+    return (at == -1) ? -1 : from + at;
 }
 
-/*** file i/o ***/
+/*** find ***/
+
+struct SearchWorker {
+    pthread_t thread;
+    int started;
+    int start, end;
+    const char* query;
+    int len;
+    struct SearchIndex found;
+};
 
-void EditorLinesToString(struct String* str) {
-    StringFree(str);
-    for (int i = 0; i < config.lines; ++i) {
-        str->len += config.line[i].str.len + 1;
+void SearchAddMatch(struct SearchIndex* index, int y, int x) {
+    if (index->count == index->cap) {
+        index->cap = (index->cap == 0) ? 256 : index->cap * 2;
+        index->match = realloc(index->match, index->cap * sizeof(struct SearchMatch));
     }
+    index->match[index->count].y = y;
+    index->match[index->count].x = x;
+    ++index->count;
+}
 
-    str->buf = (char*)malloc(str->len);
-    char* ptr = str->buf;
-    for (int i = 0; i < config.lines; ++i) {
-        int len = config.line[i].str.len;
-        memcpy(ptr, config.line[i].str.buf, len);
-        ptr += len;
-        *ptr = '\n';
-        ++ptr;
+// searches the lines of a cold block from `index` on without thawing it, decompressing into `buf`;
+// its text is searched as a whole and a match is placed on a line only once found
+int SearchColdBlock(struct SearchWorker* worker, struct ColdBlock* cold, int count, int index, int y, char* buf) {
+    char* text = ColdText(cold, buf);
+    char* end = &text[cold->len];
+    char* line = text;
+    for (int i = 0; i < index; ++i) line = (char*)memchr(line, '\n', end - line) + 1;
+
+    int at = y;
+    for (char* from = line; from < end && at < worker->end; ) {
+        int found = SearchFind(from, end - from, worker->query, worker->len);
+        if (found == -1) break;
+
+        // the query holds no line breaks, so the match lies on the line it starts in
+        char* match = &from[found];
+        for (char* nl = memchr(line, '\n', match - line); nl != NULL; nl = memchr(line, '\n', match - line)) {
+            line = nl + 1;
+            ++at;
+        }
+        if (at < worker->end) SearchAddMatch(&worker->found, at, match - line);
+        from = match + 1;
     }
+    return y + count - index;
 }
 
-void EditorOpen(const char* fileName) {
-    free(config.fileName);
-    config.fileName = strdup(fileName);
+// collects the matches in lines [start, end), workers only read the document and walk its blocks
+// directly, leaving the recently touched order to the main thread
+void* SearchWorkerRun(void* arg) {
+    struct SearchWorker* worker = (struct SearchWorker*)arg;
+    char* buf = NULL;
+    int cap = 0;
 
-    FILE* file = fopen(fileName, "r");
-    if (file == NULL) Die("fopen");
+    int rank, index;
+    struct LineBlock* block = BlockLocate(worker->start, &rank, &index);
+    for (int y = worker->start; y < worker->end && block != NULL; block = block->next, index = 0) {
+        if (block->line == NULL) {
+            struct ColdBlock* cold = block->cold;
+            if (cold->packed > 0 && cold->len > cap) {
+                cap = cold->len;
+                free(buf);
+                buf = malloc(cap);
+            }
+            y = SearchColdBlock(worker, cold, block->count, index, y, buf);
+            continue;
+        }
 
-    char* line = NULL;
-    int cap = 0;
-    int len;
-    while ((len = (int)getline(&line, (size_t*)&cap, file)) != -1) {
-        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) --len;
+        for (; index < block->count && y < worker->end; ++index, ++y) {
+            struct EditorLine* line = &block->line[index];
+            int x = LineFind(line, 0, worker->query, worker->len);
+            while (x != -1) {
+                SearchAddMatch(&worker->found, y, x);
+                x = LineFind(line, x + 1, worker->query, worker->len);
+            }
+        }
+    }
+    free(buf);
+    return NULL;
+}
 
-        EditorInsertLine(line, len, config.lines);
+void SearchBuildIndex(struct SearchIndex* index, const char* query, int len) {
+    index->count = 0;
+    if (len == 0 || config.lines == 0) return;
+
+    int threads = config.lines / SEARCH_MIN_LINES + 1;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > cores) threads = (cores < 1) ? 1 : cores;
+    if (threads > SEARCH_MAX_THREADS) threads = SEARCH_MAX_THREADS;
+
+    struct SearchWorker worker[SEARCH_MAX_THREADS];
+    int per = (config.lines + threads - 1) / threads;
+    for (int i = 0; i < threads; ++i) {
+        worker[i].start = i * per;
+        worker[i].end = (i + 1) * per;
+        if (worker[i].end > config.lines) worker[i].end = config.lines;
+        worker[i].query = query;
+        worker[i].len = len;
+        memset(&worker[i].found, 0, sizeof(struct SearchIndex));
+        worker[i].started = i > 0 && pthread_create(&worker[i].thread, NULL, SearchWorkerRun, &worker[i]) == 0;
     }
-    free(line);
-    fclose(file);
 
-    config.dirty = 0;
+    for (int i = 0; i < threads; ++i) {
+        if (worker[i].started) {
+            pthread_join(worker[i].thread, NULL);
+        }
+        else {
+            SearchWorkerRun(&worker[i]);
+        }
+    }
+
+    // the ranges are in document order, so concatenating keeps the index sorted
+    for (int i = 0; i < threads; ++i) {
+        struct SearchIndex* found = &worker[i].found;
+        if (index->count + found->count > index->cap) {
+            index->cap = index->count + found->count;
+            index->match = realloc(index->match, index->cap * sizeof(struct SearchMatch));
+        }
+        if (found->count > 0) {
+            memcpy(&index->match[index->count], found->match, found->count * sizeof(struct SearchMatch));
+            index->count += found->count;
+        }
+        free(found->match);
+    }
 }
 
-void EditorSave(void) {
-    if (config.fileName == NULL) {
-        config.fileName = EditorPrompt("Save as: %s", NULL);
-        if (config.fileName == NULL) {
-            EditorSetMessage("Save aborted");
+int SearchLocate(struct SearchIndex* index, int y, int x) {
+    int low = 0;
+    int high = index->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        struct SearchMatch* match = &index->match[mid];
+        if (match->y < y || (match->y == y && match->x < x)) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
         }
     }
+    return low;
+}
+
+// keeps only the matches of a query that extends the indexed one, every match of the longer
+// query starts where the shorter one matched, so there is no need to look anywhere else
+void SearchNarrow(struct SearchIndex* index, const char* query, int len) {
+    struct LineBlock* block = NULL;
+    int first = 0;
+    int y = 0;     // line `text` is at, in a cold block read without thawing it
+    char* text = NULL;
+    char* end = NULL;
+    char* buf = NULL;
+    int cap = 0;
+    int count = 0;
+    for (int i = 0; i < index->count; ++i) {
+        struct SearchMatch* match = &index->match[i];
+        if (block == NULL || match->y >= first + block->count) {
+            int rank, at;
+            block = BlockLocate(match->y, &rank, &at);
+            first = match->y - at;
+            if (block->line == NULL) {
+                if (block->cold->packed > 0 && block->cold->len > cap) {
+                    cap = block->cold->len;
+                    free(buf);
+                    buf = malloc(cap);
+                }
+                text = ColdText(block->cold, buf);
+                end = &text[block->cold->len];
+                y = first;
+            }
+        }
 
-    int fd = open(config.fileName, O_RDWR | O_CREAT, 0644);
-    if (fd == -1) return;
+        int keep;
+        if (block->line != NULL) {
+            struct EditorLine* line = &block->line[match->y - first];
+            keep = match->x + len <= line->str.len && LineMatchAt(line, match->x, query, len);
+        }
+        else {
+            for (; y < match->y; ++y) text = (char*)memchr(text, '\n', end - text) + 1;
+            int lineLen;
+            ColdNextLine(block->cold, text, end, &lineLen);
+            keep = match->x + len <= lineLen && memcmp(&text[match->x], query, len) == 0;
+        }
+        if (keep) index->match[count++] = *match;
+    }
+    index->count = count;
+    free(buf);
+}
 
-    struct String str = STR_INIT;
-    EditorLinesToString(&str);
+void SearchUpdate(struct SearchIndex* index, const char* query) {
+    int len = strlen(query);
+    int extended = index->valid && index->query != NULL && len >= index->queryLen
+            && memcmp(query, index->query, index->queryLen) == 0;
 
-    if (ftruncate(fd, str.len) != -1 && write(fd, str.buf, str.len) == str.len) {
-        config.dirty = 0;
-        EditorSetMessage("%d bytes written to disk", str.len);
+    if (extended && len == index->queryLen) return;
+    if (extended && index->queryLen > 0) {
+        SearchNarrow(index, query, len);
     }
     else {
-        EditorSetMessage("Can't save! I/O error: %s", strerror(errno));
+        EditorIndexLoaded();
+        SearchBuildIndex(index, query, len);
     }
-        
-    close(fd);
-    StringFree(&str);
+
+    free(index->query);
+    index->query = strdup(query);
+    index->queryLen = len;
+    index->valid = 1;
 }
 
-/*** find ***/
+// called by every edit, matches can't be narrowed from an index built on other text
+void SearchInvalidate(void) {
+    config.search.valid = 0;
+}
+
+void SearchClear(struct SearchIndex* index) {
+    free(index->match);
+    free(index->query);
+    index->match = NULL;
+    index->query = NULL;
+    index->count = 0;
+    index->cap = 0;
+    index->active = 0;
+    index->valid = 0;
+}
 
 void EditorFindCallback(char* query, int key) {
-    static int lastMatch = -1;
-    static int direction = 1;
+    struct SearchIndex* index = &config.search;
 
     switch (key) {
         case '\r':
         case '\x1b':
-            lastMatch = -1;
-            direction = 1;
+            SearchClear(index);
             return;
         case ARROW_RIGHT:
         case ARROW_UP:
-            direction = 1;
+            if (index->count == 0) return;
+            index->current = SearchLocate(index, config.y, config.x + 1);
+            if (index->current == index->count) index->current = 0;
             break;
         case ARROW_LEFT:
         case ARROW_DOWN:
-            direction = -1;
+            if (index->count == 0) return;
+            index->current = SearchLocate(index, config.y, config.x) - 1;
+            if (index->current < 0) index->current = index->count - 1;
             break;
-        default:
-            lastMatch = -1;
-            direction = 1;
+        default: {
+                long long start = ProfBegin();
+                SearchUpdate(index, query);
+                ProfEnd(PROF_SEARCH, start);
+                index->active = 1;
+                index->current = 0;
+                if (index->count == 0) return;
+            }
             break;
     }
 
-    if (lastMatch == -1) direction = 1;
-    int current = lastMatch;
-
-    for (int i = 0; i < config.lines; ++i) {
-        current += direction;
-        if (current < 0) {
-            current = config.lines - 1;
-        }
-        else if (current >= config.lines) {
-            current = 0;
-        }
-
-        struct EditorLine* line = &config.line[current];
-        int len = line->render.len;
-        char* str = malloc(len);
-        memcpy(str, line->render.buf, len);
-        str[len] = '\0';
-        char* match = strstr(str, query);
-        if (match != NULL) {
-            lastMatch = current;
-            config.y = current;
-            config.x = GetLineIndex(line, match - str);
-            config.rowOffset = config.lines;
-            free(str);
-            break;
-        }
-        free(str);
-    }
+    struct SearchMatch* match = &index->match[index->current];
+    config.y = match->y;
+    config.x = match->x;
+    config.rowOffset = config.lines;
 }
 
 void EditorFind() {
@@ -576,11 +4422,54 @@ void EditorFind() {
     }
 }
 
+void EditorGoto(void) {
+    char* target = EditorPrompt("Go to line, or byte with a leading @: %s (ESC to cancel)", NULL);
+    if (target == NULL) return;
+
+    // lines count from 1 like in compiler messages, byte offsets from 0 and may be given in hex
+    int offset = target[0] == '@';
+    char* digits = &target[offset];
+    int hex = offset && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X');
+    char* end;
+    long long n = strtoll(digits, &end, hex ? 16 : 10);
+    if (end == digits || *end != '\0' || n < (offset ? 0 : 1)) {
+        EditorSetMessage("Not a %s: %.40s", offset ? "byte offset" : "line", target);
+        free(target);
+        return;
+    }
+    free(target);
+
+    int y, x = 0;
+    if (offset) {
+        EditorIndexBytes(n);
+        long long start;
+        y = DocumentLineAt(n, &start);
+        x = (int)(n - start);
+    }
+    else {
+        y = (n < INT_MAX) ? (int)n - 1 : INT_MAX - 1;
+        EditorIndexLines(y + 1);
+    }
+
+    // past the end lands on the end of the last line
+    if (y >= config.lines) {
+        y = (config.lines > 0) ? config.lines - 1 : 0;
+        struct EditorLine* line = DocumentLine(y);
+        x = (line == NULL) ? 0 : line->str.len;
+    }
+    config.y = y;
+    config.x = x;
+    config.rowOffset = config.lines;
+}
+
 /*** output ***/
 
 void EditorScroll(void) {
+    EditorIndexLines(config.y + 1);
+    EditorIndexLines(config.rowOffset + config.rows);
+
     if (config.y < config.lines) {
-        config.renderOffset = GetRenderOffset(&config.line[config.y], config.x);
+        config.renderOffset = GetRenderOffset(DocumentLine(config.y), config.x);
     }
     else {
         config.renderOffset = 0; 
@@ -600,10 +4489,13 @@ void EditorScroll(void) {
     }
 }
 
-void EditorDrawRows(struct String* term) {
+void EditorDrawRows(struct String* row) {
+    struct String attrs = STR_INIT;
+    struct LineIter it;
+    struct EditorLine* line = LineIterInit(&it, config.rowOffset);
 	for (int y = 0; y < config.rows; ++y) {
-        int row = config.rowOffset + y;
-        if (row >= config.lines) {
+        StringTruncate(row, 0);
+        if (line == NULL) {
             if (config.lines == 0 && y == config.rows / 3) {
                 char welcome[64] = { 0 };
                 int len = snprintf(welcome, 64, "%s editor - version %s", EDITOR_NAME, EDITOR_VERSION);
@@ -611,77 +4503,105 @@ void EditorDrawRows(struct String* term) {
 
                 int padding = (config.cols - len) / 2;
                 if (padding) {
-                    StringAppend(term, "~", 1);
+                    StringAppend(row, "~", 1);
                     --padding;
                 }
-                while (padding--) StringAppend(term, " ", 1);
+                while (padding--) StringAppend(row, " ", 1);
 
-                StringAppend(term, welcome, len);
+                StringAppend(row, welcome, len);
             }
             else {
-                StringAppend(term, "~", 1);
+                StringAppend(row, "~", 1);
             }
         }
         else {
-            int len = config.line[row].render.len - config.colOffset;
-            if (len < 0) len = 0;
-            if (len > config.cols) len = config.cols;
-            StringAppend(term, &config.line[row].render.buf[config.colOffset], len);
+            EditorLineAppendRender(row, line, config.colOffset, config.cols);
+            // a line whose text changed since it was lexed is drawn plain until it is lexed again
+            if (config.syntax != NULL && line->hl != NULL && (line->flags & LINE_LEXED)) {
+                StringTruncate(&attrs, 0);
+                EditorLineAppendHighlight(&attrs, line, config.colOffset, row->len);
+                ScreenDrawCells(y, row->buf, (unsigned char*)attrs.buf, row->len);
+                line = LineIterNext(&it);
+                continue;
+            }
+            line = LineIterNext(&it);
         }
 
-		TerminalClearLine(term);
-        StringAppend(term, "\r\n", 2);
+        ScreenDrawRow(y, row->buf, row->len, ATTR_DEFAULT);
 	}
+    StringFree(&attrs);
 }
 
-void EditorDrawStatusBar(struct String* term) {
-    TerminalInvertColor(term);
-
-    char status[64];
-    int len = snprintf(status, sizeof(status), "%.20s - %d lines %s", (config.fileName == NULL) ? "[No name]" : config.fileName,
-            config.lines, (config.dirty == 0) ? "" : "(modified)");
-    char rStatus[64];
-    int rLen = snprintf(rStatus, sizeof(rStatus), "%d/%d", config.y, config.lines);
+void EditorDrawStatusBar(struct String* row) {
+    StringTruncate(row, 0);
+
+    char progress[32];
+    int loading = EditorLoadProgress(progress, sizeof(progress)) > 0;
+    char status[96];
+    int len = snprintf(status, sizeof(status), "%.20s - %d%s lines%s %s", (config.fileName == NULL) ? "[No name]" : config.fileName,
+            config.lines, loading ? "+" : "", progress, (config.dirty == 0) ? "" : "(modified)");
+    if (len >= (int)sizeof(status)) len = sizeof(status) - 1;
+    long long offset = DocumentOffset(config.y) + config.x;
+    char rStatus[80];
+    int rLen = 0;
+    if (config.search.active && config.search.count == 0) {
+        rLen = snprintf(rStatus, sizeof(rStatus), "no matches%s | @%lld | %d/%d", config.loader.active ? " yet" : "", offset, config.y + 1, config.lines);
+    }
+    else if (config.search.active) {
+        rLen = snprintf(rStatus, sizeof(rStatus), "match %d of %d%s | @%lld | %d/%d", config.search.current + 1, config.search.count,
+                config.loader.active ? "+" : "", offset, config.y + 1, config.lines);
+    }
+    else {
+        rLen = snprintf(rStatus, sizeof(rStatus), "@%lld | %d/%d", offset, config.y + 1, config.lines);
+    }
     
     if (len > config.cols) len = config.cols;
-    StringAppend(term, status, len);
+    StringAppend(row, status, len);
 
     for (int i = len; i < config.cols - rLen; ++i) {
-        StringAppend(term, " ", 1);
+        StringAppend(row, " ", 1);
     }
 
-    StringAppend(term, rStatus, rLen);
+    StringAppend(row, rStatus, rLen);
 
-    TerminalDefaultColor(term);
-    StringAppend(term, "\r\n", 2);
+    ScreenDrawRow(config.rows, row->buf, row->len, ATTR_INVERT);
 }
 
-void EditorDrawMessage(struct String* term) {
-    TerminalClearLine(term);
-
-    if (time(NULL) - config.msgTime > 5) return;
+void EditorDrawMessage(void) {
+    if (config.prof.overlay) {
+        char overlay[256];
+        int len = ProfFormat(overlay, sizeof(overlay));
+        ScreenDrawRow(config.rows + 1, overlay, len, ATTR_DEFAULT);
+        return;
+    }
 
     int len = strlen(config.msg);
-    if (len > config.cols) len = config.cols;
-    StringAppend(term, config.msg, len);
+    if (MonotonicMs() - config.msgTime >= EDITOR_MSG_MS) len = 0;
+
+    ScreenDrawRow(config.rows + 1, config.msg, len, ATTR_DEFAULT);
 }
 
 void EditorRefreshScreen(void) {
+    long long start = ProfBegin();
     EditorScroll();
+    ProfEnd(PROF_SCROLL, start);
 
-	struct String term = STR_INIT;
-
-	TerminalHideCursor(&term);
-    TerminalSetCursor(&term, 1, 1);
-
-	EditorDrawRows(&term);
-    EditorDrawStatusBar(&term);
-    EditorDrawMessage(&term);
-
-	TerminalSetCursor(&term, (config.y - config.rowOffset) + 1, (config.renderOffset - config.colOffset) + 1);
-	TerminalShowCursor(&term);
+    start = ProfBegin();
+    HighlightUpdate(config.rowOffset + config.rows);
+	struct String row = STR_INIT;
+	EditorDrawRows(&row);
+    EditorDrawStatusBar(&row);
+    EditorDrawMessage();
+	StringFree(&row);
+    ProfEnd(PROF_DRAW, start);
 
-	write(STDOUT_FILENO, term.buf, term.len);
+	struct String term = STR_INIT;
+    ScreenScroll(&term, config.rows, config.rowOffset - config.screen.rowOffset);
+    ScreenFlush(&term, config.y - config.rowOffset, config.renderOffset - config.colOffset);
+    config.screen.rowOffset = config.rowOffset;
+    start = ProfBegin();
+	TerminalWrite(&term);
+    ProfEnd(PROF_WRITE, start);
 	StringFree(&term);
 }
 
@@ -691,7 +4611,9 @@ void EditorSetMessage(const char* fmt, ...) {
     vsnprintf(config.msg, EDITOR_MSG_LEN, fmt, ap);
     va_end(ap);
 
-    config.msgTime = time(NULL);
+    // the expired message is cleared even if no key comes
+    config.msgTime = MonotonicMs();
+    EventSetTimer(TIMER_MESSAGE, config.msgTime + EDITOR_MSG_MS, EditorRefreshScreen);
 }
 
 /*** input ***/
@@ -741,8 +4663,80 @@ char* EditorPrompt(char* prompt, void (*callback)(char*, int)) {
     }
 }
 
+void EditorPaste(void) {
+    struct InputBuffer* in = &config.input;
+    struct String text = STR_INIT;
+    int endLen = sizeof(VT100_PASTE_END) - 1;
+
+    // the marker may arrive split across reads, so how much of it matched outlives a refill
+    int matched = 0;
+    while (matched < endLen) {
+        if (in->pos == in->len && InputFill(-1) == 0) continue;
+
+        if (matched == 0) {
+            char* start = &in->buf[in->pos];
+            char* esc = memchr(start, '\x1b', in->len - in->pos);
+            int len = (esc == NULL) ? in->len - in->pos : esc - start;
+            StringAppend(&text, start, len);
+            in->pos += len;
+            if (esc == NULL) continue;
+        }
+
+        char c = in->buf[in->pos++];
+        if (c == VT100_PASTE_END[matched]) {
+            ++matched;
+            continue;
+        }
+        // not the end marker after all, keep what was read as text
+        StringAppend(&text, VT100_PASTE_END, matched);
+        matched = c == '\x1b';
+        if (matched == 0) StringAppend(&text, &c, 1);
+    }
+
+    // terminals send pasted line breaks as \r, the document only knows \n
+    int len = 0;
+    for (int i = 0; i < text.len; ++i) {
+        if (text.buf[i] == '\r' && i + 1 < text.len && text.buf[i + 1] == '\n') continue;
+        text.buf[len++] = (text.buf[i] == '\r') ? '\n' : text.buf[i];
+    }
+    EditorInsertText(text.buf, len);
+    StringFree(&text);
+}
+
+// keys that change the text or the file, refused while the file is followed
+int EditorKeyEdits(int key) {
+    switch (key) {
+        case CTRL_KEY('q'):
+        case CTRL_KEY('f'):
+        case CTRL_KEY('g'):
+        case CTRL_KEY('p'):
+        case CTRL_KEY('t'):
+        case CTRL_KEY('l'):
+        case HOME:
+        case END:
+        case PAGE_UP:
+        case PAGE_DOWN:
+        case ARROW_LEFT:
+        case ARROW_DOWN:
+        case ARROW_UP:
+        case ARROW_RIGHT:
+        case '\x1b':
+        case PASTE_END:
+            return 0;
+    }
+    return 1;
+}
+
 void EditorKeyActions(int key) {
-    struct EditorLine* line = (config.y >= config.lines) ? NULL : &config.line[config.y];
+    if (config.follow.active && EditorKeyEdits(key)) {
+        EditorSetMessage("The file is followed read-only, Ctrl-T stops following");
+        return;
+    }
+
+    // navigation may step past the lines split so far
+    EditorIndexLines(config.rowOffset + 2 * config.rows + 1);
+
+    struct EditorLine* line = DocumentLine(config.y);
     int len = (line == NULL) ? 0 : line->str.len;
 
     static int quitCount = EDITOR_QUIT_CONFIRM;
@@ -760,8 +4754,9 @@ void EditorKeyActions(int key) {
                 }
 				struct String str = STR_INIT;
 				TerminalClear(&str);
-				write(STDOUT_FILENO, str.buf, str.len);
+				TerminalWrite(&str);
 				StringFree(&str);
+                JournalDiscard();
 				exit(0);
 			}
 			break;
@@ -777,6 +4772,25 @@ void EditorKeyActions(int key) {
         case CTRL_KEY('f'):
             EditorFind();
             break;
+        case CTRL_KEY('g'):
+            EditorGoto();
+            break;
+        case PASTE_START:
+            EditorPaste();
+            break;
+        case CTRL_KEY('z'):
+            EditorUndo();
+            break;
+        case CTRL_KEY('y'):
+            EditorRedo();
+            break;
+        case CTRL_KEY('p'):
+            ProfToggleOverlay();
+            break;
+        case CTRL_KEY('t'):
+            if (config.follow.active) FollowStop();
+            else FollowStart();
+            break;
         case BACKSPACE:
         case CTRL_KEY('h'):
         case DELETE:
@@ -796,7 +4810,7 @@ void EditorKeyActions(int key) {
 			}
             else if (config.y > 0) {
                 --config.y;
-                config.x = config.line[config.y].str.len;
+                config.x = DocumentLine(config.y)->str.len;
             }
 			break;
 		case ARROW_DOWN:
@@ -820,13 +4834,17 @@ void EditorKeyActions(int key) {
 			break;
         case CTRL_KEY('l'):
         case '\x1b':
+        case PASTE_END:
             break;
         default:
             EditorInsertChar(key);
             break;
 	}
 
-    line = (config.y >= config.lines) ? NULL : &config.line[config.y];
+    // the line past the end is only there to append to once the whole document arrived
+    if (config.loader.active && config.y >= config.lines && config.lines > 0) config.y = config.lines - 1;
+
+    line = DocumentLine(config.y);
     len = (line == NULL) ? 0 : line->str.len;
     if (config.x > len) {
         config.x = len;
@@ -838,7 +4856,9 @@ void EditorKeyActions(int key) {
 
 void EditorProcessKeypress(void) {
 	int c = EditorReadKey();
+    long long start = ProfBegin();
     EditorKeyActions(c);
+    ProfEnd(PROF_KEYS, start);
 }
 
 /*** init ***/
@@ -850,33 +4870,410 @@ void InitEditor(void) {
     config.rowOffset = 0;
     config.colOffset = 0;
     config.lines = 0;
-    config.line = NULL;
+    config.root = NULL;
+    config.firstBlock = NULL;
+    config.lastBlock = NULL;
     config.dirty = 0;
     config.fileName = NULL;
+    config.map = NULL;
+    config.mapLen = 0;
+    config.mapIndexed = 0;
+    config.mapFd = -1;
+    config.journal.fd = -1;
+    config.events.wake[0] = -1;
+    config.events.wake[1] = -1;
     config.msg[0] = '\0';
     config.msgTime = 0;
 
+#ifdef EDITOR_BENCH
+    config.rows = BENCH_ROWS;
+    config.cols = BENCH_COLS;
+#else
 	if (GetTerminalSize(&config.rows, &config.cols) == -1) {
 		Die("GetTerminalSize");
 	}
+#endif
+    ScreenResize(config.rows, config.cols);
     config.rows -= 2;
+
+    SearchInit();
+    ScanInit();
+    ProfOpenTrace(getenv(PROF_TRACE_ENV));
+
+    char* budget = getenv(UNDO_BUDGET_ENV);
+    char* end = budget;
+    long long mb = (budget == NULL) ? -1 : strtoll(budget, &end, 10);
+    config.undo.budget = (mb >= 0 && end != budget && *end == '\0') ? (size_t)mb << 20 : UNDO_BUDGET;
 }
 
+#ifndef EDITOR_BENCH
 int main(int argc, char* argv[]) { 
     startTime = time(NULL);
 
+    // "-f file" follows the file as it grows
+    int follow = argc > 2 && strcmp(argv[1], "-f") == 0;
+    if (follow) {
+        --argc;
+        ++argv;
+    }
+
+    // "-" reads the document from stdin, the keys then come from the controlling terminal
+    int input = -1;
+    if (argc > 1 && strcmp(argv[1], "-") == 0) {
+        input = dup(STDIN_FILENO);
+        int tty = open("/dev/tty", O_RDWR);
+        if (input == -1 || tty == -1 || dup2(tty, STDIN_FILENO) == -1) Die("/dev/tty");
+        close(tty);
+    }
+
 	EnableRawMode();
 	InitEditor();
-    if (argc > 1) {
+    EventInit();
+    EditorSetMessage("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find | Ctrl-G = goto | Ctrl-Z/Y = undo/redo | Ctrl-P = perf | Ctrl-T = follow");
+    if (input != -1) {
+        EditorLoad(input);
+    }
+    else if (argc > 1) {
         EditorOpen(argv[1]);
+        if (follow) FollowStart();
     }
 
-    EditorSetMessage("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find");
-
 	while (1) {
 		EditorRefreshScreen();
-		EditorProcessKeypress();
+        // everything already typed or pasted is handled before the next frame is drawn
+        do {
+            EditorProcessKeypress();
+        } while (EditorInputPending());
+        JournalCommit();
 	}
 
 	return 0;
 }
+#endif
+
+/*** bench ***/
+
+#ifdef EDITOR_BENCH
+
+// replays scripted keystrokes against a pretend terminal and reports how long each took to handle and draw
+
+struct BenchStat {
+    const char* name;
+    double* sample;
+    int count;
+    int cap;
+    long long bytes;
+};
+
+struct BenchState {
+    int* key; // queued for EditorReadKey, consumed by the prompts EditorKeyActions opens
+    int keyCount;
+    int keyNext;
+    int keyCap;
+    struct String frame;
+    long long bytes;
+};
+struct BenchState bench = { 0 };
+
+void BenchCapture(const char* buf, int len) {
+    StringTruncate(&bench.frame, 0);
+    StringAppend(&bench.frame, buf, len);
+    bench.bytes += len;
+}
+
+void BenchQueueKey(int key) {
+    if (bench.keyCount == bench.keyCap) {
+        bench.keyCap = (bench.keyCap == 0) ? 64 : bench.keyCap * 2;
+        bench.key = realloc(bench.key, bench.keyCap * sizeof(int));
+    }
+    bench.key[bench.keyCount++] = key;
+}
+
+void BenchQueueString(const char* str) {
+    while (*str) BenchQueueKey(*str++);
+}
+
+int BenchNextKey(void) {
+    // a prompt waiting for more than the script gave is cancelled
+    if (bench.keyNext == bench.keyCount) return '\x1b';
+
+    int key = bench.key[bench.keyNext++];
+    if (bench.keyNext == bench.keyCount) bench.keyNext = bench.keyCount = 0;
+    return key;
+}
+
+double BenchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+void BenchAddSample(struct BenchStat* stat, double us, long long bytes) {
+    if (stat->count == stat->cap) {
+        stat->cap = (stat->cap == 0) ? 64 : stat->cap * 2;
+        stat->sample = realloc(stat->sample, stat->cap * sizeof(double));
+    }
+    stat->sample[stat->count++] = us;
+    stat->bytes += bytes;
+}
+
+void BenchKey(struct BenchStat* stat, int key) {
+    long long bytes = bench.bytes;
+    double start = BenchNow();
+    EditorKeyActions(key);
+    JournalCommit();
+    EditorRefreshScreen();
+    BenchAddSample(stat, BenchNow() - start, bench.bytes - bytes);
+}
+
+int BenchCompare(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+double BenchPercentile(struct BenchStat* stat, double p) {
+    return stat->sample[(int)(p * (stat->count - 1))];
+}
+
+void BenchReport(struct BenchStat* stat) {
+    if (stat->count == 0) return;
+    qsort(stat->sample, stat->count, sizeof(double), BenchCompare);
+    printf("%-8s %7d %10.1f %10.1f %10.1f %10.1f %10lld\n", stat->name, stat->count, BenchPercentile(stat, 0.5),
+            BenchPercentile(stat, 0.9), BenchPercentile(stat, 0.99), stat->sample[stat->count - 1], stat->bytes / stat->count);
+    free(stat->sample);
+}
+
+long long BenchResident(void) {
+    FILE* fp = fopen("/proc/self/status", "r");
+    if (fp == NULL) return -1;
+
+    char buf[256];
+    long long kb = -1;
+    while (kb == -1 && fgets(buf, sizeof(buf), fp) != NULL) {
+        if (strncmp(buf, "RssAnon:", 8) == 0) kb = atoll(&buf[8]);
+    }
+    fclose(fp);
+    return kb;
+}
+
+// appends log lines to the saved file while following it, the text read should be packed
+// away as it goes cold rather than stay resident
+void BenchFollow(const char* path) {
+    FollowStart();
+    if (config.follow.active == 0) return;
+
+    long long resident = BenchResident();
+    int fd = open(path, O_WRONLY | O_APPEND);
+    char* buf = malloc(1 << 20);
+    int id = 0;
+    for (int mb = 0; mb < BENCH_FOLLOW_MB && fd != -1; ++mb) {
+        int len = 0;
+        while (len < (1 << 20) - 128) {
+            len += snprintf(&buf[len], 128, "request %d handled in %d ms by worker %d\n", id, id % 97, id % 8);
+            ++id;
+        }
+        if (write(fd, buf, len) != len) break;
+        FollowUpdate();
+    }
+    free(buf);
+    if (fd != -1) close(fd);
+    FollowStop();
+
+    if (resident != -1) {
+        printf("follow: %d MB appended, %lld MB more resident\n", BENCH_FOLLOW_MB, (BenchResident() - resident) >> 10);
+    }
+}
+
+struct BenchWriter {
+    int fd;
+    const char* text;
+};
+
+// the text arrives well after an escape sequence typed as keys would have timed out
+void* BenchWriteLate(void* arg) {
+    struct BenchWriter* writer = (struct BenchWriter*)arg;
+    struct timespec delay = { 0, 3 * INPUT_ESC_MS * 1000000L };
+    nanosleep(&delay, NULL);
+    write(writer->fd, writer->text, strlen(writer->text));
+    return NULL;
+}
+
+// pastes `first` as if it was already read and `rest` as the next read of the terminal, checking
+// that the paste holds `want` and the keys typed after the end marker are still there
+int BenchPasteSplit(const char* first, const char* rest, const char* want, const char* after) {
+    int fds[2];
+    if (pipe(fds) == -1) return 0;
+    int saved = dup(STDIN_FILENO);
+    dup2(fds[0], STDIN_FILENO);
+    struct BenchWriter writer = { fds[1], rest };
+    pthread_t thread;
+    int started = pthread_create(&thread, NULL, BenchWriteLate, &writer) == 0;
+    if (started == 0) write(fds[1], rest, strlen(rest));
+
+    struct InputBuffer* in = &config.input;
+    in->len = strlen(first);
+    in->pos = 0;
+    memcpy(in->buf, first, in->len);
+    config.y = config.lines;
+    config.x = 0;
+    EditorPaste();
+
+    struct EditorLine* line = DocumentLine(config.lines - 1);
+    int ok = line != NULL && line->str.len == (int)strlen(want) && memcmp(EditorLineText(line), want, line->str.len) == 0 &&
+            in->len - in->pos == (int)strlen(after) && memcmp(&in->buf[in->pos], after, in->len - in->pos) == 0;
+    in->pos = in->len = 0;
+
+    if (started) pthread_join(thread, NULL);
+    dup2(saved, STDIN_FILENO);
+    close(saved);
+    close(fds[0]);
+    close(fds[1]);
+    return ok;
+}
+
+void BenchGenerate(void) {
+    static const char* words[] = { "static", "int", "return", "config", "line", "buffer", "while", "struct",
+        "editor", "\t", "the", "render", "offset", "for", "if", "char" };
+    char buf[256];
+    for (int y = 0; y < BENCH_LINES; ++y) {
+        int len = snprintf(buf, sizeof(buf), "%d", y);
+        int count = rand() % 16;
+        for (int i = 0; i < count; ++i) {
+            len += snprintf(&buf[len], sizeof(buf) - len, " %s", words[rand() % 16]);
+        }
+        EditorInsertLine(buf, len, config.lines);
+    }
+    config.dirty = 0;
+}
+
+void BenchQuery(char* query, int len) {
+    for (int attempt = 0; attempt < 100 && config.lines > 0; ++attempt) {
+        struct EditorLine* line = DocumentLine(rand() % config.lines);
+        if (line->str.len < len) continue;
+
+        int at = rand() % (line->str.len - len + 1);
+        int i = 0;
+        while (i < len && isprint((unsigned char)LineChar(line, at + i))) {
+            query[i] = LineChar(line, at + i);
+            ++i;
+        }
+        if (i == len) {
+            query[len] = '\0';
+            return;
+        }
+    }
+    strcpy(query, "int");
+}
+
+int main(int argc, char* argv[]) {
+    struct BenchStat open = { "open", NULL, 0, 0, 0 };
+    struct BenchStat typing = { "typing", NULL, 0, 0, 0 };
+    struct BenchStat delete = { "delete", NULL, 0, 0, 0 };
+    struct BenchStat enter = { "enter", NULL, 0, 0, 0 };
+    struct BenchStat join = { "join", NULL, 0, 0, 0 };
+    struct BenchStat paste = { "paste", NULL, 0, 0, 0 };
+    struct BenchStat undo = { "undo", NULL, 0, 0, 0 };
+    struct BenchStat scroll = { "scroll", NULL, 0, 0, 0 };
+    struct BenchStat search = { "search", NULL, 0, 0, 0 };
+    struct BenchStat save = { "save", NULL, 0, 0, 0 };
+
+    startTime = time(NULL);
+    srand(1);
+    InitEditor();
+
+    double start = BenchNow();
+    if (argc > 1) EditorOpen(argv[1]);
+    else BenchGenerate();
+    EditorRefreshScreen();
+    BenchAddSample(&open, BenchNow() - start, bench.bytes);
+    EditorIndexAll();
+
+    printf("%s: %d lines, %dx%d terminal\n", (argc > 1) ? argv[1] : "generated", config.lines, BENCH_COLS, BENCH_ROWS);
+
+    // saves go to a scratch file so the input is never touched
+    char saveName[] = "/tmp/kilo-bench" SAVE_SUFFIX;
+    int fd = mkstemp(saveName);
+    if (fd == -1) Die("mkstemp");
+    close(fd);
+    free(config.fileName);
+    config.fileName = strdup(saveName);
+
+    const char* text = "while (line != NULL) line = LineIterNext(&it);\tthe quick brown fox ";
+    config.y = (config.lines > 0) ? (config.lines - 1) / 2 : 0;
+    config.x = (config.lines > 0) ? DocumentLine(config.y)->str.len / 2 : 0;
+    EditorRefreshScreen();
+    // splitting and joining lines copy the rest of the line, so they are timed apart from the keys that don't
+    for (int i = 0; i < BENCH_KEYS; ++i) {
+        if (i % 64 == 63) BenchKey(&enter, '\r');
+        else BenchKey(&typing, text[i % strlen(text)]);
+    }
+    for (int i = 0; i < BENCH_KEYS; ++i) {
+        BenchKey((config.x == 0) ? &join : &delete, BACKSPACE);
+    }
+
+    struct String snippet = STR_INIT;
+    while (snippet.len < (50 << 10)) {
+        StringAppend(&snippet, text, strlen(text));
+        StringAppend(&snippet, "\n", 1);
+    }
+    for (int i = 0; i < 20; ++i) {
+        long long bytes = bench.bytes;
+        double start = BenchNow();
+        EditorInsertText(snippet.buf, snippet.len);
+        JournalCommit();
+        EditorRefreshScreen();
+        BenchAddSample(&paste, BenchNow() - start, bench.bytes - bytes);
+    }
+    StringFree(&snippet);
+    for (int i = 0; i < 20; ++i) {
+        BenchKey(&undo, CTRL_KEY('z'));
+    }
+
+    config.y = 0;
+    config.x = 0;
+    EditorRefreshScreen();
+    for (int i = 0; i < BENCH_KEYS; ++i) {
+        BenchKey(&scroll, ARROW_DOWN);
+    }
+    for (int i = 0; i < BENCH_KEYS; ++i) {
+        BenchKey(&scroll, ARROW_UP);
+    }
+
+    for (int i = 0; i < 50; ++i) {
+        char query[8];
+        BenchQuery(query, 3 + i % 4);
+        BenchQueueString(query);
+        BenchQueueKey('\r');
+        BenchKey(&search, CTRL_KEY('f'));
+    }
+
+    for (int i = 0; i < 10; ++i) {
+        EditorKeyActions('x');
+        BenchKey(&save, CTRL_KEY('s'));
+    }
+    JournalDiscard();
+
+    printf("%-8s %7s %10s %10s %10s %10s %10s\n", "op", "keys", "p50 us", "p90 us", "p99 us", "max us", "bytes/key");
+    BenchReport(&open);
+    BenchReport(&typing);
+    BenchReport(&delete);
+    BenchReport(&enter);
+    BenchReport(&join);
+    BenchReport(&paste);
+    BenchReport(&undo);
+    BenchReport(&scroll);
+    BenchReport(&search);
+    BenchReport(&save);
+    BenchFollow(saveName);
+    unlink(saveName);
+
+    int pasted = BenchPasteSplit("abc\x1b[20", "1~def", "abc", "def") && BenchPasteSplit("x\x1b[2", "2y\x1b[201~", "x\x1b[22y", "");
+    printf("paste: end marker split across reads %s\n", pasted ? "ok" : "FAILED");
+
+    StringFree(&bench.frame);
+    free(bench.key);
+    return pasted ? 0 : 1;
+}
+
+#endif
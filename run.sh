@@ -1,3 +1,3 @@
 #!/usr/bin/env bash
 
-gcc kilo.c -o kilo -Wall -Wextra -Werror -pedantic -std=c99 && ./kilo $@
+gcc kilo.c -o kilo -Wall -Wextra -Werror -pedantic -std=c99 -pthread && ./kilo $@